@@ -0,0 +1,114 @@
+// admission.hpp
+#ifndef ADMISSION_HPP
+#define ADMISSION_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+
+// -------------------------
+// AdmissionControl Class
+// -------------------------
+// Server-wide limits on open connections and on requests in flight (admitted
+// and not yet answered), shared by every I/O thread. A limit of 0 means
+// unlimited. Taking a slot is one atomic add, and one subtract to undo it
+// when the limit is already reached.
+class AdmissionControl {
+public:
+    AdmissionControl(size_t max_connections, size_t max_in_flight)
+        : max_connections_(max_connections), max_in_flight_(max_in_flight) {}
+
+    AdmissionControl(const AdmissionControl &) = delete;
+    AdmissionControl &operator=(const AdmissionControl &) = delete;
+
+    // Each successful open_connection() must be paired with close_connection().
+    bool open_connection() { return acquire(connections_, max_connections_); }
+    void close_connection() { connections_.fetch_sub(1, std::memory_order_relaxed); }
+
+    // Each successful admit_request() must be paired with finish_request().
+    bool admit_request() { return acquire(in_flight_, max_in_flight_); }
+    void finish_request() { in_flight_.fetch_sub(1, std::memory_order_relaxed); }
+
+    // Once draining, connections are told to close after their current
+    // response instead of waiting for another request.
+    void start_draining() { draining_.store(true, std::memory_order_relaxed); }
+    bool draining() const { return draining_.load(std::memory_order_relaxed); }
+
+    size_t connections() const { return connections_.load(std::memory_order_relaxed); }
+    size_t in_flight() const { return in_flight_.load(std::memory_order_relaxed); }
+    size_t max_connections() const { return max_connections_; }
+    size_t max_in_flight() const { return max_in_flight_; }
+
+private:
+    static bool acquire(std::atomic<size_t> &count, size_t limit) {
+        size_t previous = count.fetch_add(1, std::memory_order_relaxed);
+        if (limit != 0 && previous >= limit) {
+            count.fetch_sub(1, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    const size_t max_connections_;
+    const size_t max_in_flight_;
+    std::atomic<size_t> connections_{0};
+    std::atomic<size_t> in_flight_{0};
+    std::atomic<bool> draining_{false};
+};
+
+// -------------------------
+// QueueDelayShedder Class
+// -------------------------
+// CoDel's overload test applied to one I/O thread's event loop. The samples
+// are queue delays: how long work that was ready had to wait before the
+// thread got to it. A short burst that the thread drains is fine; a
+// standing queue, where even the smallest delay stays above target for a
+// whole interval, means the thread is taking in more than it can serve.
+// From then on the thread sheds new requests until a sample comes back
+// below target. A target of zero turns the shedder off. Single-threaded.
+class QueueDelayShedder {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    QueueDelayShedder(Clock::duration target, Clock::duration interval)
+        : target_(target), interval_(interval) {}
+
+    void record(Clock::time_point now, Clock::duration delay) {
+        if (target_ == Clock::duration::zero()) {
+            return;
+        }
+        above_target_ = delay > target_;
+        if (!above_target_) {
+            reset();
+            return;
+        }
+        if (above_since_ == Clock::time_point()) {
+            above_since_ = now;
+        }
+        if (!shedding_ && now - above_since_ >= interval_) {
+            shedding_ = true;
+        }
+    }
+
+    // Forget the history, e.g. when sampling stops.
+    void reset() {
+        above_target_ = false;
+        shedding_ = false;
+        above_since_ = Clock::time_point();
+    }
+
+    // The last sample was above target.
+    bool above_target() const { return above_target_; }
+
+    // The queue delay has stayed above target for at least an interval.
+    bool shedding() const { return shedding_; }
+
+private:
+    const Clock::duration target_;
+    const Clock::duration interval_;
+    Clock::time_point above_since_;
+    bool above_target_ = false;
+    bool shedding_ = false;
+};
+
+#endif // ADMISSION_HPP
@@ -0,0 +1,207 @@
+// arena.hpp
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+// -------------------------
+// MonotonicArena Class
+// -------------------------
+// Bump allocator for per-request scratch memory. Nothing is freed until
+// reset(), which rewinds to the start. If a request needed more than one
+// block, reset() replaces them with a single block of the combined size, so
+// once the arena has seen its largest request it stops calling malloc.
+// The first block is only allocated on first use.
+class MonotonicArena {
+public:
+    static constexpr size_t kDefaultBlockSize = 4096;
+
+    explicit MonotonicArena(size_t block_size = kDefaultBlockSize) : block_size_(block_size) {}
+
+    ~MonotonicArena() { release(); }
+
+    MonotonicArena(const MonotonicArena &) = delete;
+    MonotonicArena &operator=(const MonotonicArena &) = delete;
+
+    void *allocate(size_t size, size_t alignment) {
+        size_t offset = head_ ? align_up(used_, alignment) : 0;
+        if (!head_ || offset + size > head_->size) {
+            add_block(size + alignment);
+            offset = align_up(used_, alignment);
+        }
+        used_ = offset + size;
+        return head_->data() + offset;
+    }
+
+    bool owns(const void *p) const {
+        auto address = reinterpret_cast<uintptr_t>(p);
+        for (const Block *block = head_; block; block = block->next) {
+            auto begin = reinterpret_cast<uintptr_t>(block->data());
+            if (address >= begin && address < begin + block->size) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void reset() {
+        if (head_ && head_->next) {
+            size_t total = 0;
+            for (const Block *block = head_; block; block = block->next) {
+                total += block->size;
+            }
+            release();
+            add_block(total);
+        }
+        used_ = 0;
+    }
+
+    // Bytes reserved from the heap, for memory accounting.
+    size_t capacity() const {
+        size_t total = 0;
+        for (const Block *block = head_; block; block = block->next) {
+            total += block->size;
+        }
+        return total;
+    }
+
+private:
+    struct Block {
+        Block *next;
+        size_t size;
+        char *data() { return reinterpret_cast<char *>(this + 1); }
+        const char *data() const { return reinterpret_cast<const char *>(this + 1); }
+    };
+
+    static size_t align_up(size_t value, size_t alignment) {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    void add_block(size_t min_size) {
+        size_t size = block_size_;
+        while (size < min_size) {
+            size *= 2;
+        }
+        void *memory = std::malloc(sizeof(Block) + size);
+        if (!memory) {
+            throw std::bad_alloc();
+        }
+        head_ = new (memory) Block{head_, size};
+        used_ = 0;
+    }
+
+    void release() {
+        while (head_) {
+            Block *next = head_->next;
+            std::free(head_);
+            head_ = next;
+        }
+    }
+
+    size_t block_size_;
+    Block *head_ = nullptr;  // the block being filled; older blocks follow
+    size_t used_ = 0;        // bytes used in head_
+};
+
+// -------------------------
+// ArenaAllocator
+// -------------------------
+// nlohmann::basic_json default-constructs its allocators, so this one is
+// stateless: it draws from whichever arena an ArenaScope has made current on
+// this thread, and from the heap when there is none. Everything allocated
+// inside a scope must be destroyed before the scope ends.
+class ArenaScope {
+public:
+    explicit ArenaScope(MonotonicArena &arena) : previous_(current_) { current_ = &arena; }
+    ~ArenaScope() { current_ = previous_; }
+
+    ArenaScope(const ArenaScope &) = delete;
+    ArenaScope &operator=(const ArenaScope &) = delete;
+
+    static MonotonicArena *current() { return current_; }
+
+private:
+    MonotonicArena *previous_;
+    static inline thread_local MonotonicArena *current_ = nullptr;
+};
+
+template <typename T>
+struct ArenaAllocator {
+    using value_type = T;
+
+    ArenaAllocator() noexcept = default;
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &) noexcept {}
+
+    T *allocate(size_t n) {
+        if (MonotonicArena *arena = ArenaScope::current()) {
+            return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+        }
+        return static_cast<T *>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t) noexcept {
+        MonotonicArena *arena = ArenaScope::current();
+        if (arena && arena->owns(p)) {
+            return;
+        }
+        ::operator delete(p);
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U> &) const noexcept { return false; }
+};
+
+using ArenaString = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+
+// A JSON document whose nodes, containers and strings all live in the
+// current arena; used for request bodies.
+using ArenaJson = nlohmann::basic_json<std::map, std::vector, ArenaString, bool, std::int64_t,
+                                       std::uint64_t, double, ArenaAllocator>;
+
+// Deep-copy an arena-backed document into an ordinary json that may outlive
+// the request.
+inline nlohmann::json to_heap_json(const ArenaJson &value) {
+    using value_t = nlohmann::json::value_t;
+    switch (value.type()) {
+    case value_t::object: {
+        nlohmann::json object = nlohmann::json::object();
+        for (auto it = value.begin(); it != value.end(); ++it) {
+            object[std::string(it.key().data(), it.key().size())] = to_heap_json(it.value());
+        }
+        return object;
+    }
+    case value_t::array: {
+        nlohmann::json array = nlohmann::json::array();
+        for (const auto &element : value) {
+            array.push_back(to_heap_json(element));
+        }
+        return array;
+    }
+    case value_t::string: {
+        const auto &text = value.get_ref<const ArenaString &>();
+        return std::string(text.data(), text.size());
+    }
+    case value_t::boolean:
+        return value.get<bool>();
+    case value_t::number_integer:
+        return value.get<std::int64_t>();
+    case value_t::number_unsigned:
+        return value.get<std::uint64_t>();
+    case value_t::number_float:
+        return value.get<double>();
+    default:
+        return nullptr;
+    }
+}
+
+#endif // ARENA_HPP
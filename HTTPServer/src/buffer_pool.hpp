@@ -0,0 +1,207 @@
+// buffer_pool.hpp
+#ifndef BUFFER_POOL_HPP
+#define BUFFER_POOL_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <vector>
+#include "huge_pages.hpp"
+
+// -------------------------
+// BufferPool Class
+// -------------------------
+// Receive buffers for one I/O thread, in three sizes: 4, 8 and 16 KiB. Each
+// size is carved out of slabs that are mapped as the pool grows and kept for
+// reuse; free buffers form an intrusive list per size. Slabs are 64 KiB, or
+// one 2 MiB huge page when huge pages are on (see huge_pages.hpp). Larger
+// buffers (only bodies bigger than 16 KiB need them) come straight from the
+// heap. Single-threaded; the counters are relaxed atomics so stats readers
+// on other threads can see them.
+class BufferPool {
+public:
+    static constexpr size_t kMinBufferSize = 4096;
+    static constexpr size_t kMaxBufferSize = 16384;
+    static constexpr size_t kSlabSize = 65536;
+
+    struct Counters {
+        std::atomic<size_t> buffers_in_use{0};
+        std::atomic<size_t> buffers_total{0};    // carved from slabs, in use or free
+        std::atomic<size_t> bytes_in_use{0};
+        std::atomic<size_t> bytes_reserved{0};   // slabs plus oversized buffers
+        std::atomic<size_t> oversized_buffers{0};
+        huge_pages::Counters mappings;         // slabs and other pooled I/O memory
+    };
+
+    explicit BufferPool(Counters &counters, huge_pages::Mode huge_pages = huge_pages::Mode::off)
+        : counters_(counters), huge_pages_(huge_pages),
+          slab_size_(huge_pages == huge_pages::Mode::off ? kSlabSize : huge_pages::kHugePageSize) {}
+
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+
+    // The size of the buffer acquire() hands out for a request of size bytes.
+    static size_t buffer_size_for(size_t size) {
+        size_t buffer_size = kMinBufferSize;
+        while (buffer_size < size && buffer_size < kMaxBufferSize) {
+            buffer_size *= 2;
+        }
+        return buffer_size < size ? size : buffer_size;
+    }
+
+    // size must come from buffer_size_for().
+    char *acquire(size_t size) {
+        char *buffer;
+        if (size > kMaxBufferSize) {
+            buffer = new char[size];
+            add(counters_.bytes_reserved, size);
+            add(counters_.oversized_buffers, 1);
+        } else {
+            FreeBuffer *&head = free_[size_class(size)];
+            if (!head) {
+                add_slab(size);
+            }
+            buffer = reinterpret_cast<char *>(head);
+            head = head->next;
+        }
+        add(counters_.buffers_in_use, 1);
+        add(counters_.bytes_in_use, size);
+        return buffer;
+    }
+
+    void release(char *buffer, size_t size) {
+        if (size > kMaxBufferSize) {
+            delete[] buffer;
+            sub(counters_.bytes_reserved, size);
+            sub(counters_.oversized_buffers, 1);
+        } else {
+            FreeBuffer *&head = free_[size_class(size)];
+            head = new (buffer) FreeBuffer{head};
+        }
+        sub(counters_.buffers_in_use, 1);
+        sub(counters_.bytes_in_use, size);
+    }
+
+private:
+    struct FreeBuffer {
+        FreeBuffer *next;
+    };
+
+    static size_t size_class(size_t size) {
+        return size == kMinBufferSize ? 0 : size == kMinBufferSize * 2 ? 1 : 2;
+    }
+
+    void add_slab(size_t size) {
+        slabs_.push_back(huge_pages::map(slab_size_, huge_pages_, &counters_.mappings));
+        char *slab = slabs_.back().data();
+        size_t slab_size = slabs_.back().size();
+        FreeBuffer *&head = free_[size_class(size)];
+        for (size_t offset = slab_size; offset >= size; offset -= size) {
+            head = new (slab + offset - size) FreeBuffer{head};
+        }
+        add(counters_.buffers_total, slab_size / size);
+        add(counters_.bytes_reserved, slab_size);
+    }
+
+    static void add(std::atomic<size_t> &counter, size_t amount) {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    static void sub(std::atomic<size_t> &counter, size_t amount) {
+        counter.store(counter.load(std::memory_order_relaxed) - amount, std::memory_order_relaxed);
+    }
+
+    Counters &counters_;
+    huge_pages::Mode huge_pages_;
+    size_t slab_size_;
+    std::array<FreeBuffer *, 3> free_{};
+    std::vector<huge_pages::Mapping> slabs_;
+};
+
+// -------------------------
+// ReceiveBuffer Class
+// -------------------------
+// A connection's view of the bytes it has received but not yet consumed,
+// [begin, end) within a pooled buffer. It holds a buffer only while there are
+// unconsumed bytes: consuming the last one hands the buffer back, so an idle
+// keep-alive connection owns no receive memory at all. The buffer is
+// replaced by a larger one only when a request does not fit.
+class ReceiveBuffer {
+public:
+    explicit ReceiveBuffer(BufferPool &pool) : pool_(pool) {}
+    ~ReceiveBuffer() { release(); }
+
+    ReceiveBuffer(const ReceiveBuffer &) = delete;
+    ReceiveBuffer &operator=(const ReceiveBuffer &) = delete;
+
+    bool empty() const { return begin_ == end_; }
+    const char *data() const { return data_ + begin_; }
+    size_t size() const { return end_ - begin_; }
+
+    // Free space after the received bytes, valid after reserve().
+    char *tail() { return data_ + end_; }
+    size_t tail_size() const { return capacity_ - end_; }
+
+    // Make room to receive at least one more byte, and room for the whole
+    // request when its size is known (request_size, else 0). Slides the
+    // pending bytes to the front or moves them to a larger buffer when it has
+    // to; returns true if they moved.
+    bool reserve(size_t request_size) {
+        size_t pending = size();
+        size_t needed = std::max(request_size, pending + 1);
+        if (data_ && end_ < capacity_ && begin_ + needed <= capacity_) {
+            return false;
+        }
+        if (data_ && needed <= capacity_) {
+            std::memmove(data_, data_ + begin_, pending);
+        } else {
+            size_t capacity = BufferPool::buffer_size_for(needed);
+            char *grown = pool_.acquire(capacity);
+            if (data_) {
+                std::memcpy(grown, data_ + begin_, pending);
+                pool_.release(data_, capacity_);
+            }
+            data_ = grown;
+            capacity_ = capacity;
+        }
+        begin_ = 0;
+        end_ = pending;
+        return true;
+    }
+
+    // Append bytes from elsewhere (the io_uring provided buffers).
+    void append(const char *bytes, size_t count) {
+        reserve(size() + count);
+        std::memcpy(tail(), bytes, count);
+        end_ += count;
+    }
+
+    void commit(size_t count) { end_ += count; }
+
+    void consume(size_t count) {
+        begin_ += count;
+        if (begin_ == end_) {
+            release();
+        }
+    }
+
+    void release() {
+        if (data_) {
+            pool_.release(data_, capacity_);
+            data_ = nullptr;
+            capacity_ = begin_ = end_ = 0;
+        }
+    }
+
+private:
+    BufferPool &pool_;
+    char *data_ = nullptr;
+    size_t capacity_ = 0;
+    size_t begin_ = 0;
+    size_t end_ = 0;
+};
+
+#endif // BUFFER_POOL_HPP
@@ -1,3 +1,4 @@
+#include <utility>  // before Boost: 1.74's awaitable.hpp uses std::exchange without including it
 #include <boost/asio.hpp>
 #include <iostream>
 #include <string>
@@ -8,18 +9,82 @@
 #include <mutex>
 #include <numeric>
 #include <algorithm>
+#include <map>
+#include <memory>
 #include <sstream>
 #include <nlohmann/json.hpp>
+#include <new>
+#include <cstdlib>
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "http_parser.hpp"
+#include "simd_scan.hpp"
+#include "router.hpp"
+#include "timing_wheel.hpp"
+#include "stats_shard.hpp"
 using boost::asio::ip::tcp;
 using namespace std::chrono;
 using namespace std;
 using json = nlohmann::json;
+// Counts every global operator new so the microbenchmarks can report
+// allocations per operation.
+static std::atomic<size_t> g_allocations{0};
+
+void *operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+// One counter shard per thread. Latencies are collected by each thread and
+// appended under m once it is done.
 struct BenchmarkStats {
-    std::atomic<size_t> total_requests{0};
-    std::atomic<size_t> failed_requests{0};
+    explicit BenchmarkStats(size_t threads) : counters(threads) {}
+
+    ShardedStats counters;
     std::vector<double> latencies;
     std::mutex m;
 };
+
+// The status code of a response, or 0 if the status line is not HTTP/1.x.
+static int response_status(const std::string &response) {
+    if (response.size() < 12 || response.compare(0, 7, "HTTP/1.") != 0) {
+        return 0;
+    }
+    return std::atoi(response.c_str() + 9);
+}
+// Parse the response headers for Content-Length, skipping the status line.
+static size_t response_content_length(const char *headers, size_t header_end) {
+    size_t content_length = 0;
+    size_t pos = simd_scan::find_value_end(headers, header_end) + 2;
+    while (pos + 2 < header_end) {
+        size_t name_end = pos + simd_scan::find_name_end(headers + pos, header_end - pos);
+        size_t line_end = pos + simd_scan::find_value_end(headers + pos, header_end - pos);
+        if (name_end < line_end && headers[name_end] == ':' &&
+            iequals(std::string_view(headers + pos, name_end - pos), "content-length")) {
+            std::string len_str(headers + name_end + 1, line_end - name_end - 1);
+            try {
+                content_length = std::stoul(len_str);
+            } catch (...) {
+                content_length = 0;
+            }
+        }
+        pos = line_end + 2;
+    }
+    return content_length;
+}
+
 // This function creates a new socket, sends a POST request with a JSON payload to "/api/benchmark",
 // reads the complete HTTP response, and then returns it as a string.
 std::string send_request(const std::string &host, unsigned short port, const std::string &path = "/api/benchmark") {
@@ -52,60 +117,31 @@ std::string send_request(const std::string &host, unsigned short port, const std
 
         boost::asio::write(socket, boost::asio::buffer(request));
 
-        // Read response headers (until "\r\n\r\n").
-        boost::asio::streambuf response_buffer;
-        boost::asio::read_until(socket, response_buffer, "\r\n\r\n");
-
-        // Extract the header block.
-        std::string header_block(
-            boost::asio::buffers_begin(response_buffer.data()),
-            boost::asio::buffers_end(response_buffer.data())
-        );
-        //] Received headers:\n" << header_block << endl;
-
-        // Find end of header block.
-        size_t header_end = header_block.find("\r\n\r\n");
-        if (header_end != std::string::npos)
-            header_end += 4;
-        else
-            header_end = header_block.size();
-
-        // Parse headers to get Content-Length.
-        std::istringstream header_stream(header_block);
-        std::string header_line;
-        size_t content_length = 0;
-        while (std::getline(header_stream, header_line)) {
-            if (!header_line.empty() && header_line.back() == '\r') {
-                header_line.pop_back();
-            }
-            if (header_line.empty())
-                break;
-            if (header_line.find("Content-Length:") == 0) {
-                std::string len_str = header_line.substr(15);
-                len_str.erase(0, len_str.find_first_not_of(" "));
-                try {
-                    content_length = std::stoul(len_str);
-                } catch (...) {
-                    content_length = 0;
-                }
+        // Read until the header block is complete. The terminator search
+        // rescans only the last few bytes that could straddle a read.
+        std::string response;
+        size_t header_end = 0;
+        char chunk[4096];
+        while (header_end == 0) {
+            size_t scanned = response.size() > 3 ? response.size() - 3 : 0;
+            size_t n = socket.read_some(boost::asio::buffer(chunk));
+            response.append(chunk, n);
+            size_t found = simd_scan::find_head_end(response.data() + scanned, response.size() - scanned);
+            if (found != 0) {
+                header_end = scanned + found;
             }
         }
-        //cout << "[DEBUG] Parsed Content-Length: " << content_length << endl;
 
-        // Determine how many body bytes are already in the buffer.
-        size_t already_read = 0;
-        if (response_buffer.size() > header_end)
-            already_read = response_buffer.size() - header_end;
-        //cout << "[DEBUG] Bytes already read for body: " << already_read << endl;
+        size_t content_length = response_content_length(response.data(), header_end);
+        //cout << "[DEBUG] Parsed Content-Length: " << content_length << endl;
 
         // Read the remaining body if necessary.
+        size_t already_read = response.size() - header_end;
         if (content_length > 0 && already_read < content_length) {
-            boost::asio::read(socket, response_buffer, boost::asio::transfer_exactly(content_length - already_read));
+            response.resize(header_end + content_length);
+            boost::asio::read(socket, boost::asio::buffer(&response[header_end + already_read],
+                                                          content_length - already_read));
         }
-
-        std::stringstream ss;
-        ss << &response_buffer;
-        std::string response = ss.str();
        // cout << "[DEBUG] Full response received (" << response.size() << " bytes): " << response << endl;
 
         return response;
@@ -116,23 +152,27 @@ std::string send_request(const std::string &host, unsigned short port, const std
 }
 
 
-// Worker thread that calls send_request repeatedly.
-void worker_thread(const std::string &host, unsigned short port, size_t num_requests, BenchmarkStats &stats) {
+// Worker thread that calls send_request repeatedly, counting into shard index.
+void worker_thread(const std::string &host, unsigned short port, size_t num_requests, BenchmarkStats &stats,
+                   size_t index) {
+    StatsShard &shard = stats.counters.shard(index);
+    std::vector<double> latencies;
+    latencies.reserve(num_requests);
     for (size_t i = 0; i < num_requests; ++i) {
         auto start = high_resolution_clock::now();
         try {
             std::string response = send_request(host, port);
             auto end = high_resolution_clock::now();
-            double latency = duration_cast<microseconds>(end - start).count() / 1000.0;
-            std::lock_guard<std::mutex> lock(stats.m);
-            stats.latencies.push_back(latency);
-            stats.total_requests++;
+            latencies.push_back(duration_cast<microseconds>(end - start).count() / 1000.0);
+            StatsShard::bump(shard.bytes_received, response.size());
+            shard.count_response(response_status(response));
         } catch (std::exception &e) {
-            std::lock_guard<std::mutex> lock(stats.m);
-            stats.failed_requests++;
+            shard.count_error(LoadError::bad_response);
             cerr << "Request " << i << " failed: " << e.what() << endl;
         }
     }
+    std::lock_guard<std::mutex> lock(stats.m);
+    stats.latencies.insert(stats.latencies.end(), latencies.begin(), latencies.end());
 }
 
 void print_stats(const BenchmarkStats &stats, double duration) {
@@ -147,29 +187,728 @@ void print_stats(const BenchmarkStats &stats, double duration) {
     double p50 = latencies[latencies.size() * 0.5];
     double p95 = latencies[latencies.size() * 0.95];
     double p99 = latencies[latencies.size() * 0.99];
+    ShardedStats::Totals counters = stats.counters.merge();
     cout << "\nBenchmark Results:\n"
          << "==================\n"
          << "Total Duration: " << duration << " seconds\n"
-         << "Total Requests: " << stats.total_requests << "\n"
-         << "Failed Requests: " << stats.failed_requests << "\n"
-         << "Throughput: " << stats.total_requests / duration << " requests/second\n"
+         << "Total Requests: " << counters.requests << "\n"
+         << "Failed Requests: " << counters.failures << "\n"
+         << "Throughput: " << counters.requests / duration << " requests/second\n"
          << "Average Latency: " << avg << " ms\n"
          << "P50 Latency: " << p50 << " ms\n"
          << "P95 Latency: " << p95 << " ms\n"
          << "P99 Latency: " << p99 << " ms\n";
 }
 
-int main() {
+// -------------------------
+// Request Parser Microbenchmark
+// -------------------------
+// Realistic request heads: a bare curl GET, a browser navigation and the
+// frontend's axios POST to /api/benchmark.
+static const std::vector<std::pair<std::string, std::string>> kParserSamples = {
+    {"curl GET",
+     "GET /api/stats HTTP/1.1\r\n"
+     "Host: localhost:8080\r\n"
+     "User-Agent: curl/8.5.0\r\n"
+     "Accept: */*\r\n"
+     "\r\n"},
+    {"browser GET",
+     "GET /static/js/main.3f9a1c2b.js HTTP/1.1\r\n"
+     "Host: localhost:3000\r\n"
+     "Connection: keep-alive\r\n"
+     "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+     "sec-ch-ua-mobile: ?0\r\n"
+     "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+     "sec-ch-ua-platform: \"Linux\"\r\n"
+     "Accept: */*\r\n"
+     "Sec-Fetch-Site: same-origin\r\n"
+     "Sec-Fetch-Mode: no-cors\r\n"
+     "Sec-Fetch-Dest: script\r\n"
+     "Referer: http://localhost:3000/\r\n"
+     "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+     "Accept-Language: en-US,en;q=0.9\r\n"
+     "Cookie: _ga=GA1.1.1234567890.1700000000; session=4f1d2c3b4a5968778695a4b3c2d1e0f0\r\n"
+     "\r\n"},
+    {"axios POST",
+     "POST /api/benchmark HTTP/1.1\r\n"
+     "Host: localhost:8080\r\n"
+     "Connection: keep-alive\r\n"
+     "Content-Length: 44\r\n"
+     "Accept: application/json, text/plain, */*\r\n"
+     "Content-Type: application/json\r\n"
+     "Origin: http://localhost:3000\r\n"
+     "Referer: http://localhost:3000/\r\n"
+     "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+     "Accept-Encoding: gzip, deflate, br\r\n"
+     "Accept-Language: en-US,en;q=0.9\r\n"
+     "\r\n"
+     "{\"num_threads\":4,\"requests_per_thread\":1000}"},
+};
+
+// The server's original parsing path: streambuf, getline per header and an
+// istringstream for the request line.
+static size_t parse_with_istream(const std::string &raw) {
+    boost::asio::streambuf buffer;
+    buffer.sputn(raw.data(), raw.size());
+    std::istream request_stream(&buffer);
+    std::string request_line;
+    std::getline(request_stream, request_line);
+    std::string header;
+    size_t content_length = 0;
+    while (std::getline(request_stream, header) && header != "\r") {
+        if (header.find("Content-Length: ") == 0) {
+            content_length = std::stoul(header.substr(16));
+        }
+    }
+    std::istringstream request_line_stream(request_line);
+    std::string method, path, version;
+    request_line_stream >> method >> path >> version;
+    return content_length + method.size() + path.size();
+}
+
+static size_t parse_with_state_machine(HttpRequestParser &parser, const std::string &raw) {
+    parser.reset();
+    if (parser.parse(raw.data(), raw.size()) != HttpRequestParser::Result::complete) {
+        throw std::runtime_error("sample did not parse");
+    }
+    const HttpRequest &request = parser.request();
+    return request.content_length + request.method.size() + request.path.size();
+}
+
+template <typename F>
+static void time_parser(const std::string &name, size_t iterations, F &&parse_once) {
+    size_t sink = 0;
+    size_t allocations_before = g_allocations.load(std::memory_order_relaxed);
+    auto start = steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        sink += parse_once();
+    }
+    auto end = steady_clock::now();
+    size_t allocations = g_allocations.load(std::memory_order_relaxed) - allocations_before;
+    double ns = duration_cast<nanoseconds>(end - start).count() / static_cast<double>(iterations);
+    cout << "  " << name << ": " << ns << " ns/request, "
+         << static_cast<double>(allocations) / iterations << " allocations/request"
+         << (sink == 0 ? " " : "") << "\n";
+}
+
+// Split a head into lines with the given value-end kernel; this is the raw
+// delimiter scanning that the parser's header loop is built on.
+static size_t count_lines(const std::string &raw, size_t (*find_value_end)(const char *, size_t)) {
+    size_t lines = 0;
+    size_t pos = 0;
+    while (pos < raw.size()) {
+        pos += find_value_end(raw.data() + pos, raw.size() - pos) + 2;
+        ++lines;
+    }
+    return lines;
+}
+
+void run_parser_benchmark(size_t iterations) {
+    cout << "Request parser microbenchmark (" << iterations << " iterations per sample, "
+         << simd_scan::kernels.name << " scan kernel)\n";
+    HttpRequestParser parser;
+    for (auto &sample : kParserSamples) {
+        const std::string &raw = sample.second;
+        cout << sample.first << " (" << raw.size() << " bytes):\n";
+        time_parser("istream/getline", iterations, [&]() { return parse_with_istream(raw); });
+        time_parser("state machine  ", iterations, [&]() { return parse_with_state_machine(parser, raw); });
+        time_parser("line scan, scalar", iterations, [&]() { return count_lines(raw, simd_scan::find_value_end_scalar); });
+        time_parser("line scan, simd  ", iterations, [&]() { return count_lines(raw, simd_scan::kernels.find_value_end); });
+    }
+}
+
+// -------------------------
+// Router Microbenchmark
+// -------------------------
+// Builds route tables of increasing size shaped like a REST API (half static
+// routes, half with a ':id' parameter) and times lookups of matching paths
+// against the trie router and an if/else-style linear scan. First checks
+// that a lookup backs up from a static segment to a ':param' sibling.
+bool run_router_benchmark(size_t iterations) {
+    {
+        Router<size_t> router;
+        router.add(HttpMethod::GET, "/a/b/c", 1);
+        router.add(HttpMethod::GET, "/a/:x/d", 2);
+        router.add(HttpMethod::POST, "/a/b/e", 3);
+        router.add(HttpMethod::GET, "/a/:x/e", 4);
+        RouteParams params;
+        auto routes_to = [&](HttpMethod method, std::string_view path) {
+            auto match = router.find(method, path, params);
+            return match.handler ? *match.handler : 0;
+        };
+        bool ok = routes_to(HttpMethod::GET, "/a/b/c") == 1 && routes_to(HttpMethod::GET, "/a/b/d") == 2 &&
+                  params.get("x") == "b" && routes_to(HttpMethod::GET, "/a/z/d") == 2 &&
+                  routes_to(HttpMethod::POST, "/a/b/e") == 3 && routes_to(HttpMethod::GET, "/a/b/e") == 4 &&
+                  router.find(HttpMethod::PUT, "/a/b/e", params).status ==
+                      Router<size_t>::Status::method_not_allowed &&
+                  router.find(HttpMethod::GET, "/a/b/f", params).status == Router<size_t>::Status::not_found;
+        cout << "Static/parameter backtracking: " << (ok ? "ok" : "FAILED") << "\n";
+        if (!ok) {
+            return false;
+        }
+    }
+    cout << "Router microbenchmark (" << iterations << " lookups per table)\n";
+    for (size_t num_routes : {10, 100, 1000}) {
+        std::vector<std::string> patterns;
+        std::vector<std::string> paths;
+        for (size_t i = 0; i < num_routes; ++i) {
+            std::string base = "/api/v1/service" + std::to_string(i % 16) + "/resource" + std::to_string(i);
+            if (i % 2 == 0) {
+                patterns.push_back(base);
+                paths.push_back(base);
+            } else {
+                patterns.push_back(base + "/:id");
+                paths.push_back(base + "/" + std::to_string(100000 + i));
+            }
+        }
+
+        Router<size_t> router;
+        for (size_t i = 0; i < num_routes; ++i) {
+            router.add(HttpMethod::GET, patterns[i], i);
+        }
+
+        // Visit paths in a scrambled order so the scan is not always lucky.
+        std::vector<size_t> order(num_routes);
+        for (size_t i = 0; i < num_routes; ++i) {
+            order[i] = (i * 7919) % num_routes;
+        }
+
+        size_t sink = 0;
+        RouteParams params;
+        auto start = steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i) {
+            auto match = router.find(HttpMethod::GET, paths[order[i % num_routes]], params);
+            sink += match.handler ? *match.handler : 0;
+        }
+        double trie_ns = duration_cast<nanoseconds>(steady_clock::now() - start).count() /
+                         static_cast<double>(iterations);
+
+        // Linear scan: compare against every pattern in turn, the way an
+        // if/else chain of path comparisons behaves.
+        auto matches = [](std::string_view pattern, std::string_view path) {
+            size_t p = 0, q = 0;
+            while (p < pattern.size() && q < path.size()) {
+                if (pattern[p] == ':') {
+                    while (p < pattern.size() && pattern[p] != '/') ++p;
+                    while (q < path.size() && path[q] != '/') ++q;
+                } else if (pattern[p++] != path[q++]) {
+                    return false;
+                }
+            }
+            return p == pattern.size() && q == path.size();
+        };
+        size_t linear_iterations = std::max<size_t>(1, iterations / num_routes * 10);
+        start = steady_clock::now();
+        for (size_t i = 0; i < linear_iterations; ++i) {
+            const std::string &path = paths[order[i % num_routes]];
+            for (size_t r = 0; r < num_routes; ++r) {
+                if (matches(patterns[r], path)) {
+                    sink += r;
+                    break;
+                }
+            }
+        }
+        double linear_ns = duration_cast<nanoseconds>(steady_clock::now() - start).count() /
+                           static_cast<double>(linear_iterations);
+
+        cout << "  " << num_routes << " routes: trie " << trie_ns << " ns/lookup, linear "
+             << linear_ns << " ns/lookup" << (sink == 0 ? " " : "") << "\n";
+    }
+    return true;
+}
+
+// -------------------------
+// Timer Microbenchmark
+// -------------------------
+// Re-arms the deadline of a random connection, as the server does on every
+// phase change, with the per-thread timing wheel and with an ordered queue
+// (std::multimap; asio's timer queue is a binary heap, also O(log n)), then
+// times expiring them all.
+void run_timer_benchmark(size_t iterations) {
+    cout << "Timer microbenchmark (" << iterations << " re-arms per size)\n";
+    for (size_t num_timers : {1000, 10000, 100000}) {
+        std::vector<milliseconds> timeouts(1024);
+        for (size_t i = 0; i < timeouts.size(); ++i) {
+            timeouts[i] = milliseconds(1000 + (i * 7919) % 30000);
+        }
+        size_t fired = 0;
+        auto on_expiry = [](void *counter) { ++*static_cast<size_t *>(counter); };
+
+        TimingWheel wheel;
+        std::vector<std::unique_ptr<WheelTimer>> timers;
+        for (size_t i = 0; i < num_timers; ++i) {
+            timers.push_back(std::make_unique<WheelTimer>(on_expiry, &fired));
+            wheel.schedule(*timers.back(), timeouts[i % timeouts.size()]);
+        }
+        auto start = steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i) {
+            wheel.schedule(*timers[(i * 7919) % num_timers], timeouts[i % timeouts.size()]);
+        }
+        double wheel_ns = duration_cast<nanoseconds>(steady_clock::now() - start).count() /
+                          static_cast<double>(iterations);
+        start = steady_clock::now();
+        wheel.advance(steady_clock::now() + seconds(32));
+        double wheel_expire_ns = duration_cast<nanoseconds>(steady_clock::now() - start).count() /
+                                 static_cast<double>(num_timers);
+
+        using Queue = std::multimap<steady_clock::time_point, size_t>;
+        Queue queue;
+        std::vector<Queue::iterator> entries;
+        auto now = steady_clock::now();
+        for (size_t i = 0; i < num_timers; ++i) {
+            entries.push_back(queue.emplace(now + timeouts[i % timeouts.size()], i));
+        }
+        start = steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i) {
+            size_t index = (i * 7919) % num_timers;
+            queue.erase(entries[index]);
+            entries[index] = queue.emplace(now + timeouts[i % timeouts.size()], index);
+        }
+        double queue_ns = duration_cast<nanoseconds>(steady_clock::now() - start).count() /
+                          static_cast<double>(iterations);
+        start = steady_clock::now();
+        while (!queue.empty()) {
+            fired += queue.begin()->second != num_timers;
+            queue.erase(queue.begin());
+        }
+        double queue_expire_ns = duration_cast<nanoseconds>(steady_clock::now() - start).count() /
+                                 static_cast<double>(num_timers);
+
+        cout << "  " << num_timers << " timers: wheel " << wheel_ns << " ns/re-arm, " << wheel_expire_ns
+             << " ns/expiry; ordered queue " << queue_ns << " ns/re-arm, " << queue_expire_ns << " ns/expiry"
+             << (fired == 2 * num_timers ? "" : " (missed expiries)") << "\n";
+    }
+}
+
+// -------------------------
+// Stats Counter Microbenchmark
+// -------------------------
+// Every thread counts increments requests, three ways: fetch_add on one of
+// two adjacent shared atomics, as the load generator's Stats did; ++ under
+// a shared mutex, as BenchmarkStats did for failures; and a relaxed bump of
+// the thread's own StatsShard. The threads start together and the time is
+// from the start to the last one finishing.
+void run_counter_benchmark(size_t increments) {
+    struct SharedCounters {
+        std::atomic<size_t> total_requests{0};
+        std::atomic<size_t> failed_requests{0};
+    };
+    cout << "Stats counter microbenchmark (" << increments << " increments per thread)\n";
+    for (size_t num_threads : {1, 8, 64}) {
+        auto measure = [&](auto &&count, auto &&total) {
+            std::atomic<bool> go{false};
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < num_threads; ++t) {
+                threads.emplace_back([&, t]() {
+                    while (!go.load(std::memory_order_acquire)) {
+                        std::this_thread::yield();
+                    }
+                    for (size_t i = 0; i < increments; ++i) {
+                        count(t);
+                    }
+                });
+            }
+            auto start = steady_clock::now();
+            go.store(true, std::memory_order_release);
+            for (auto &thread : threads) {
+                thread.join();
+            }
+            double ns = duration_cast<nanoseconds>(steady_clock::now() - start).count() /
+                        static_cast<double>(num_threads * increments);
+            return total() == num_threads * increments ? ns : -1.0;
+        };
+
+        SharedCounters shared;
+        double shared_ns = measure([&](size_t) { shared.total_requests.fetch_add(1, std::memory_order_relaxed); },
+                                   [&] { return shared.total_requests.load(); });
+        std::mutex m;
+        size_t locked = 0;
+        double mutex_ns = measure([&](size_t) { std::lock_guard<std::mutex> lock(m); ++locked; },
+                                  [&] { return locked; });
+        ShardedStats sharded(num_threads);
+        double sharded_ns = measure([&](size_t t) { StatsShard::bump(sharded.shard(t).requests); },
+                                    [&] { return static_cast<size_t>(sharded.merge().requests); });
+
+        cout << "  " << num_threads << " threads: shared atomic " << shared_ns << " ns, mutex " << mutex_ns
+             << " ns, sharded " << sharded_ns << " ns per increment (wall time / all increments)\n";
+    }
+}
+
+// -------------------------
+// Server Configuration Benchmarks
+// -------------------------
+// Start the server binary once per configuration, drive it with keep-alive
+// GET /api/health requests from several connections, and report latency
+// percentiles next to the server's own syscall and wake-up counters.
+
+// Read one response from a keep-alive socket. Bytes past its end stay in
+// pending for the next call.
+static std::string read_response(tcp::socket &socket, std::string &pending) {
+    size_t header_end = 0;
+    char chunk[4096];
+    while ((header_end = simd_scan::find_head_end(pending.data(), pending.size())) == 0) {
+        size_t n = socket.read_some(boost::asio::buffer(chunk));
+        pending.append(chunk, n);
+    }
+    size_t total = header_end + response_content_length(pending.data(), header_end);
+    while (pending.size() < total) {
+        size_t n = socket.read_some(boost::asio::buffer(chunk));
+        pending.append(chunk, n);
+    }
+    std::string response = pending.substr(0, total);
+    pending.erase(0, total);
+    return response;
+}
+
+static json fetch_server_stats(unsigned short port) {
+    boost::asio::io_context io_context;
+    tcp::socket socket(io_context);
+    socket.connect(tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), port));
+    boost::asio::write(socket, boost::asio::buffer(std::string(
+        "GET /api/stats HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n")));
+    std::string pending;
+    std::string response = read_response(socket, pending);
+    return json::parse(response.substr(simd_scan::find_head_end(response.data(), response.size())));
+}
+
+struct ServerVariant {
+    std::string name;
+    std::vector<std::string> args;
+    std::string path = "/api/health";  // what the load requests
+};
+
+static pid_t start_server(const std::string &binary, unsigned short port, const ServerVariant &variant) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        std::vector<std::string> args = {binary, "--port", std::to_string(port), "--threads", "1"};
+        args.insert(args.end(), variant.args.begin(), variant.args.end());
+        std::vector<char *> argv;
+        for (auto &arg : args) {
+            argv.push_back(&arg[0]);
+        }
+        argv.push_back(nullptr);
+        execv(binary.c_str(), argv.data());
+        _exit(127);
+    }
+    // Wait until it accepts connections.
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        std::this_thread::sleep_for(milliseconds(50));
+        try {
+            fetch_server_stats(port);
+            return pid;
+        } catch (std::exception &) {
+        }
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    throw std::runtime_error("server did not start: " + binary);
+}
+
+// Send requests_per_connection requests on each of several keep-alive
+// connections, cycling through the given request texts. stats needs a
+// shard per connection.
+static void drive_keep_alive(unsigned short port, size_t connections, size_t requests_per_connection,
+                             const std::vector<std::string> &requests, BenchmarkStats &stats) {
+    std::vector<std::thread> threads;
+    for (size_t c = 0; c < connections; ++c) {
+        threads.emplace_back([&, c]() {
+            StatsShard &shard = stats.counters.shard(c);
+            std::vector<double> latencies;
+            latencies.reserve(requests_per_connection);
+            LoadError error = LoadError::connect;
+            try {
+                boost::asio::io_context io_context;
+                tcp::socket socket(io_context);
+                socket.connect(tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), port));
+                socket.set_option(tcp::no_delay(true));
+                error = LoadError::bad_response;
+                std::string pending;
+                for (size_t i = 0; i < requests_per_connection; ++i) {
+                    const std::string &request = requests[i % requests.size()];
+                    auto sent = steady_clock::now();
+                    boost::asio::write(socket, boost::asio::buffer(request));
+                    std::string response = read_response(socket, pending);
+                    latencies.push_back(duration_cast<nanoseconds>(steady_clock::now() - sent).count() / 1e6);
+                    StatsShard::bump(shard.bytes_sent, request.size());
+                    StatsShard::bump(shard.bytes_received, response.size());
+                    shard.count_response(response_status(response));
+                }
+            } catch (std::exception &) {
+                shard.count_error(error);
+            }
+            std::lock_guard<std::mutex> lock(stats.m);
+            stats.latencies.insert(stats.latencies.end(), latencies.begin(), latencies.end());
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+}
+
+void run_server_comparison(const std::string &binary, const std::vector<ServerVariant> &variants,
+                           size_t requests_per_connection, size_t connections, unsigned short port) {
+    cout << connections << " keep-alive connections x " << requests_per_connection
+         << " requests, 1 server thread unless noted" << endl;
+    for (const auto &variant : variants) {
+        const std::vector<std::string> load = {"GET " + variant.path + " HTTP/1.1\r\nHost: localhost\r\n\r\n"};
+        pid_t pid = start_server(binary, port, variant);
+        json before = fetch_server_stats(port);
+
+        BenchmarkStats stats(connections);
+        auto start = steady_clock::now();
+        drive_keep_alive(port, connections, requests_per_connection, load, stats);
+        double seconds = duration_cast<duration<double>>(steady_clock::now() - start).count();
+
+        json after = fetch_server_stats(port);
+        kill(pid, SIGTERM);
+        waitpid(pid, nullptr, 0);
+
+        auto latencies = stats.latencies;
+        if (latencies.empty()) {
+            cout << "  " << variant.name << ": no successful requests\n";
+            continue;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        // The stats requests themselves are included in the counters.
+        double requests = after["requests_served"].get<double>() - before["requests_served"].get<double>();
+        double syscalls = after["io_syscalls"].get<double>() - before["io_syscalls"].get<double>();
+        double allocations = after["allocations"].get<double>() - before["allocations"].get<double>();
+        const json &wakeup = after["wakeup_latency_us"];
+        cout << "  " << variant.name << ": " << stats.counters.merge().requests / seconds << " req/s, p50 "
+             << latencies[latencies.size() / 2] << " ms, p99 " << latencies[latencies.size() * 99 / 100]
+             << " ms, " << syscalls / requests << " syscalls/request, "
+             << allocations / requests << " allocations/request";
+        // Only variants run with --wakeup-probe-us sample wake-up latency.
+        if (wakeup["count"].get<size_t>() > 0) {
+            cout << ", wake-up p50/p99/max " << wakeup["p50"] << "/" << wakeup["p99"] << "/" << wakeup["max"] << " us";
+        }
+        cout << "\n";
+    }
+}
+
+// -------------------------
+// Server Allocation Check
+// -------------------------
+// After a warm-up, serving keep-alive requests on the fixed routes (including
+// error responses and a request with a body) must not allocate at all on
+// either backend. Connection setup and the /api/stats reads do allocate, so
+// two runs that differ only in requests per connection are compared: any
+// difference in allocations comes from the extra requests.
+bool run_allocation_check(const std::string &binary, unsigned short port) {
+    const std::string body = R"({"num_threads":4,"requests_per_thread":100})";
+    const std::vector<std::string> requests = {
+        "GET /api/health HTTP/1.1\r\nHost: localhost\r\n\r\n",
+        "GET /missing?x=1 HTTP/1.1\r\nHost: localhost\r\nUser-Agent: check\r\n\r\n",
+        "DELETE /api/health HTTP/1.1\r\nHost: localhost\r\n\r\n",
+        "OPTIONS /api/benchmark HTTP/1.1\r\nHost: localhost\r\n\r\n",
+        "PUT /api/stats HTTP/1.1\r\nHost: localhost\r\nContent-Length: " + std::to_string(body.size()) +
+            "\r\n\r\n" + body,
+    };
+    const size_t connections = 2;
+    const size_t requests_per_connection = 10000;
+    bool passed = true;
+    for (const ServerVariant &variant : {ServerVariant{"asio", {"--backend", "asio"}},
+                                         ServerVariant{"io_uring", {"--backend", "io_uring"}}}) {
+        pid_t pid = start_server(binary, port, variant);
+        BenchmarkStats warmup(connections);
+        drive_keep_alive(port, connections, 1000, requests, warmup);
+
+        auto allocations_for = [&](size_t requests_per_connection, BenchmarkStats &stats) {
+            size_t before = fetch_server_stats(port)["allocations"].get<size_t>();
+            drive_keep_alive(port, connections, requests_per_connection, requests, stats);
+            return static_cast<long long>(fetch_server_stats(port)["allocations"].get<size_t>() - before);
+        };
+        BenchmarkStats short_run(connections), long_run(connections);
+        long long short_allocations = allocations_for(requests.size(), short_run);
+        long long long_allocations = allocations_for(requests_per_connection, long_run);
+        kill(pid, SIGTERM);
+        waitpid(pid, nullptr, 0);
+
+        long long allocations = long_allocations - short_allocations;
+        ShardedStats::Totals short_counters = short_run.counters.merge();
+        ShardedStats::Totals long_counters = long_run.counters.merge();
+        size_t extra_requests = long_counters.requests - short_counters.requests;
+        bool ok = allocations <= 0 && short_counters.failures == 0 && long_counters.failures == 0;
+        passed = passed && ok;
+        cout << "  " << variant.name << ": " << std::max(0LL, allocations) << " allocations for "
+             << extra_requests << " extra requests " << (ok ? "(ok)" : "(FAILED)") << "\n";
+    }
+    return passed;
+}
+
+// -------------------------
+// Restart Check
+// -------------------------
+// Hot-upgrade the server (SIGUSR2) while several keep-alive clients keep
+// it busy, and count requests that fail. A client whose response says
+// Connection: close reconnects, as any HTTP client would; a refused
+// connection or a connection closed under an outstanding request is a
+// failure. The upgrade passes if nothing failed and the new process (a
+// different pid in /api/stats) is serving afterwards.
+bool run_restart_check(const std::string &binary, unsigned short port) {
+    const std::string request = "GET /api/health HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    const size_t clients = 4;
+    bool passed = true;
+    for (const ServerVariant &variant : {ServerVariant{"asio", {"--backend", "asio"}},
+                                         ServerVariant{"io_uring", {"--backend", "io_uring"}}}) {
+        pid_t pid = start_server(binary, port, variant);
+        pid_t old_pid = fetch_server_stats(port)["pid"].get<pid_t>();
+
+        std::atomic<bool> stop{false};
+        std::atomic<size_t> served{0}, failed{0}, reconnects{0};
+        std::vector<std::thread> threads;
+        for (size_t c = 0; c < clients; ++c) {
+            threads.emplace_back([&]() {
+                boost::asio::io_context io_context;
+                while (!stop) {
+                    try {
+                        tcp::socket socket(io_context);
+                        socket.connect(tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), port));
+                        std::string pending;
+                        bool keep_alive = true;
+                        while (keep_alive && !stop) {
+                            boost::asio::write(socket, boost::asio::buffer(request));
+                            std::string response = read_response(socket, pending);
+                            served++;
+                            keep_alive = response.find("Connection: close") == std::string::npos;
+                        }
+                        if (!keep_alive) {
+                            reconnects++;
+                        }
+                    } catch (std::exception &) {
+                        failed++;
+                    }
+                }
+            });
+        }
+        std::this_thread::sleep_for(milliseconds(300));
+        auto upgrade_start = steady_clock::now();
+        kill(pid, SIGUSR2);
+        waitpid(pid, nullptr, 0);  // the old process exits once it has drained
+        double upgrade_ms = duration_cast<duration<double, std::milli>>(steady_clock::now() - upgrade_start).count();
+        std::this_thread::sleep_for(milliseconds(300));
+        stop = true;
+        for (auto &t : threads) {
+            t.join();
+        }
+
+        pid_t new_pid = -1;
+        try {
+            new_pid = fetch_server_stats(port)["pid"].get<pid_t>();
+        } catch (std::exception &) {
+        }
+        // The new process is not our child; stop it and wait for the port to close.
+        if (new_pid > 0 && new_pid != old_pid) {
+            kill(new_pid, SIGTERM);
+            for (int attempt = 0; attempt < 100 && kill(new_pid, 0) == 0; ++attempt) {
+                std::this_thread::sleep_for(milliseconds(20));
+            }
+        }
+        bool ok = failed == 0 && new_pid > 0 && new_pid != old_pid;
+        passed = passed && ok;
+        cout << "  " << variant.name << ": " << served << " requests, " << failed << " failed, "
+             << reconnects << " reconnects on Connection: close, pid " << old_pid << " -> " << new_pid
+             << ", old process gone after " << upgrade_ms << " ms " << (ok ? "(ok)" : "(FAILED)") << "\n";
+    }
+    return passed;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "parser-bench") {
+        run_parser_benchmark(argc > 2 ? std::stoul(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "router-bench") {
+        return run_router_benchmark(argc > 2 ? std::stoul(argv[2]) : 1000000) ? 0 : 1;
+    }
+    if (argc > 1 && std::string(argv[1]) == "timer-bench") {
+        run_timer_benchmark(argc > 2 ? std::stoul(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "counter-bench") {
+        run_counter_benchmark(argc > 2 ? std::stoul(argv[2]) : 10000000);
+        return 0;
+    }
+    if (argc > 2 && std::string(argv[1]) == "alloc-check") {
+        try {
+            bool passed = run_allocation_check(argv[2], argc > 3 ? static_cast<unsigned short>(std::stoul(argv[3])) : 18080);
+            return passed ? 0 : 1;
+        } catch (std::exception &e) {
+            cerr << "Exception: " << e.what() << endl;
+            return 1;
+        }
+    }
+    if (argc > 2 && std::string(argv[1]) == "restart-check") {
+        try {
+            bool passed = run_restart_check(argv[2], argc > 3 ? static_cast<unsigned short>(std::stoul(argv[3])) : 18080);
+            return passed ? 0 : 1;
+        } catch (std::exception &e) {
+            cerr << "Exception: " << e.what() << endl;
+            return 1;
+        }
+    }
+    if (argc > 2 && (std::string(argv[1]) == "backend-bench" || std::string(argv[1]) == "poll-bench" ||
+                     std::string(argv[1]) == "hugepage-bench" || std::string(argv[1]) == "prefork-bench" ||
+                     std::string(argv[1]) == "coroutine-bench" || std::string(argv[1]) == "socket-bench")) {
+        std::vector<ServerVariant> variants;
+        if (std::string(argv[1]) == "backend-bench") {
+            variants = {{"asio", {"--backend", "asio"}}, {"io_uring", {"--backend", "io_uring"}}};
+        } else if (std::string(argv[1]) == "coroutine-bench") {
+            // The same canned response from a callback handler and from a coroutine handler.
+            for (const char *backend : {"asio", "io_uring"}) {
+                variants.push_back({std::string(backend) + "/callback", {"--backend", backend}, "/api/health"});
+                variants.push_back({std::string(backend) + "/coroutine", {"--backend", backend}, "/api/co/health"});
+            }
+        } else if (std::string(argv[1]) == "socket-bench") {
+            for (const char *backend : {"asio", "io_uring"}) {
+                for (const char *profile : {"kernel", "default", "latency"}) {
+                    variants.push_back({std::string(backend) + "/" + profile,
+                                        {"--backend", backend, "--socket-profile", profile}});
+                }
+            }
+        } else if (std::string(argv[1]) == "prefork-bench") {
+            // Two I/O threads either way, each with its own SO_REUSEPORT listener.
+            for (const char *backend : {"asio", "io_uring"}) {
+                variants.push_back({std::string(backend) + "/2 threads",
+                                    {"--backend", backend, "--threads", "2", "--reuse-port"}});
+                variants.push_back({std::string(backend) + "/2 processes",
+                                    {"--backend", backend, "--processes", "2", "--threads", "1"}});
+            }
+        } else if (std::string(argv[1]) == "hugepage-bench") {
+            for (const char *backend : {"asio", "io_uring"}) {
+                for (const char *mode : {"off", "thp", "hugetlb"}) {
+                    variants.push_back({std::string(backend) + "/" + mode,
+                                        {"--backend", backend, "--huge-pages", mode}});
+                }
+            }
+        } else {
+            for (const char *backend : {"asio", "io_uring"}) {
+                for (const char *mode : {"block", "hybrid", "spin"}) {
+                    variants.push_back({std::string(backend) + "/" + mode,
+                                        {"--backend", backend, "--poll-mode", mode, "--wakeup-probe-us", "1000"}});
+                }
+            }
+        }
+        try {
+            run_server_comparison(argv[2], variants, argc > 3 ? std::stoul(argv[3]) : 20000,
+                                  argc > 4 ? std::stoul(argv[4]) : 4,
+                                  argc > 5 ? static_cast<unsigned short>(std::stoul(argv[5])) : 18080);
+        } catch (std::exception &e) {
+            cerr << "Exception: " << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
     // try {
     //     const std::string host = "localhost";
     //     const unsigned short port = 8080;
     //     const size_t num_threads = 4;
     //     const size_t requests_per_thread = 1000;
-    //     BenchmarkStats stats;
+    //     BenchmarkStats stats(num_threads);
     //     std::vector<std::thread> threads;
     //     auto start_time = high_resolution_clock::now();
     //     for (size_t i = 0; i < num_threads; ++i) {
-    //         threads.emplace_back(worker_thread, host, port, requests_per_thread, std::ref(stats));
+    //         threads.emplace_back(worker_thread, host, port, requests_per_thread, std::ref(stats), i);
     //     }
     //     for (auto &t : threads) {
     //         t.join();
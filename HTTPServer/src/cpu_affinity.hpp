@@ -0,0 +1,180 @@
+// cpu_affinity.hpp
+#ifndef CPU_AFFINITY_HPP
+#define CPU_AFFINITY_HPP
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// -------------------------
+// CPU Affinity and Topology
+// -------------------------
+// Thread pinning and NUMA topology from sysfs, without libnuma. Memory
+// placement relies on the kernel's first-touch policy: per-thread state is
+// allocated and first written while the allocating thread runs on the CPU
+// that will use it, so its pages come from that CPU's node.
+namespace cpu_affinity {
+
+// Parse a Linux cpulist such as "0-3,8,10-11".
+inline std::vector<int> parse_cpu_list(const std::string &text) {
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t comma = text.find(',', pos);
+        std::string item = text.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        pos = (comma == std::string::npos) ? text.size() : comma + 1;
+        if (item.empty() || item == "\n") {
+            continue;
+        }
+        size_t dash = item.find('-');
+        try {
+            int first = std::stoi(item.substr(0, dash));
+            int last = (dash == std::string::npos) ? first : std::stoi(item.substr(dash + 1));
+            if (first < 0 || last < first || last >= CPU_SETSIZE) {
+                throw std::invalid_argument(item);
+            }
+            for (int cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        } catch (const std::exception &) {
+            throw std::invalid_argument("invalid CPU list: " + text);
+        }
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
+
+// The inverse of parse_cpu_list, collapsing runs into ranges.
+inline std::string format_cpu_list(const std::vector<int> &cpus) {
+    std::string text;
+    for (size_t i = 0; i < cpus.size();) {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) {
+            ++j;
+        }
+        if (!text.empty()) {
+            text += ',';
+        }
+        text += std::to_string(cpus[i]);
+        if (j > i) {
+            text += '-' + std::to_string(cpus[j]);
+        }
+        i = j + 1;
+    }
+    return text;
+}
+
+inline bool pin_current_thread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+// Run f() on the given CPU from the calling thread, then restore its
+// affinity; used to first-touch another thread's state on that thread's node.
+template <typename F>
+void run_on_cpu(int cpu, F &&f) {
+    cpu_set_t saved;
+    bool restore = pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved) == 0;
+    pin_current_thread(cpu);
+    try {
+        f();
+    } catch (...) {
+        if (restore) {
+            pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+        }
+        throw;
+    }
+    if (restore) {
+        pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+    }
+}
+
+// CPUs this process may run on.
+inline std::vector<int> allowed_cpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+struct NumaNode {
+    int id = 0;
+    std::vector<int> cpus;
+};
+
+struct Topology {
+    std::vector<int> online_cpus;
+    std::vector<NumaNode> nodes;
+
+    // NUMA node of a CPU, or -1 if it is not known.
+    int node_of(int cpu) const {
+        for (const auto &node : nodes) {
+            if (std::binary_search(node.cpus.begin(), node.cpus.end(), cpu)) {
+                return node.id;
+            }
+        }
+        return -1;
+    }
+};
+
+inline std::string read_first_line(const std::string &path) {
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+// Read from sysfs once. Without NUMA information everything is node 0.
+inline const Topology &topology() {
+    static const Topology topology = []() {
+        Topology t;
+        std::string online = read_first_line("/sys/devices/system/cpu/online");
+        if (!online.empty()) {
+            t.online_cpus = parse_cpu_list(online);
+        } else {
+            for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu) {
+                t.online_cpus.push_back(static_cast<int>(cpu));
+            }
+        }
+        if (DIR *dir = opendir("/sys/devices/system/node")) {
+            while (dirent *entry = readdir(dir)) {
+                std::string name = entry->d_name;
+                if (name.size() > 4 && name.compare(0, 4, "node") == 0 &&
+                    name.find_first_not_of("0123456789", 4) == std::string::npos) {
+                    NumaNode node;
+                    node.id = std::atoi(name.c_str() + 4);
+                    node.cpus = parse_cpu_list(read_first_line("/sys/devices/system/node/" + name + "/cpulist"));
+                    t.nodes.push_back(node);
+                }
+            }
+            closedir(dir);
+        }
+        if (t.nodes.empty()) {
+            t.nodes.push_back({0, t.online_cpus});
+        }
+        std::sort(t.nodes.begin(), t.nodes.end(),
+                  [](const NumaNode &a, const NumaNode &b) { return a.id < b.id; });
+        return t;
+    }();
+    return topology;
+}
+
+} // namespace cpu_affinity
+
+#endif // CPU_AFFINITY_HPP
@@ -0,0 +1,101 @@
+// handler_memory.hpp
+#ifndef HANDLER_MEMORY_HPP
+#define HANDLER_MEMORY_HPP
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// -------------------------
+// Recycled Handler Memory
+// -------------------------
+// Asio allocates an operation object for every async call. Wrapping a
+// handler with make_custom_alloc_handler() makes that object come from a
+// block owned by the caller. The block is reused by every operation that
+// starts after the previous one completed, so a connection with one read or
+// write and one timer outstanding needs one block for each. Asio frees the
+// operation before it calls the handler, so a handler that starts the next
+// operation gets the same block back. Size is the largest operation the block
+// serves; anything bigger, or a second operation at once, uses the heap.
+template <size_t Size>
+class HandlerMemory {
+public:
+    static constexpr size_t kSize = Size;
+
+    HandlerMemory() = default;
+    HandlerMemory(const HandlerMemory &) = delete;
+    HandlerMemory &operator=(const HandlerMemory &) = delete;
+
+    void *allocate(size_t size) {
+        if (!in_use_ && size <= kSize) {
+            in_use_ = true;
+            return &storage_;
+        }
+        return ::operator new(size);
+    }
+
+    void deallocate(void *p) {
+        if (p == &storage_) {
+            in_use_ = false;
+        } else {
+            ::operator delete(p);
+        }
+    }
+
+private:
+    std::aligned_storage_t<kSize, alignof(std::max_align_t)> storage_;
+    bool in_use_ = false;
+};
+
+template <typename T, typename Memory>
+class HandlerAllocator {
+public:
+    using value_type = T;
+
+    explicit HandlerAllocator(Memory &memory) : memory_(memory) {}
+
+    template <typename U>
+    HandlerAllocator(const HandlerAllocator<U, Memory> &other) noexcept : memory_(other.memory_) {}
+
+    bool operator==(const HandlerAllocator &other) const noexcept { return &memory_ == &other.memory_; }
+    bool operator!=(const HandlerAllocator &other) const noexcept { return &memory_ != &other.memory_; }
+
+    T *allocate(size_t n) const { return static_cast<T *>(memory_.allocate(sizeof(T) * n)); }
+    void deallocate(T *p, size_t) const { memory_.deallocate(p); }
+
+private:
+    template <typename, typename>
+    friend class HandlerAllocator;
+
+    Memory &memory_;
+};
+
+// A handler with an associated allocator (found by asio through
+// allocator_type / get_allocator()).
+template <typename Handler, typename Memory>
+class CustomAllocHandler {
+public:
+    using allocator_type = HandlerAllocator<Handler, Memory>;
+
+    CustomAllocHandler(Memory &memory, Handler handler)
+        : memory_(memory), handler_(std::move(handler)) {}
+
+    allocator_type get_allocator() const noexcept { return allocator_type(memory_); }
+
+    template <typename... Args>
+    void operator()(Args &&...args) {
+        handler_(std::forward<Args>(args)...);
+    }
+
+private:
+    Memory &memory_;
+    Handler handler_;
+};
+
+template <typename Handler, typename Memory>
+inline CustomAllocHandler<Handler, Memory> make_custom_alloc_handler(Memory &memory, Handler handler) {
+    return CustomAllocHandler<Handler, Memory>(memory, std::move(handler));
+}
+
+#endif // HANDLER_MEMORY_HPP
@@ -0,0 +1,355 @@
+// http_parser.hpp
+#ifndef HTTP_PARSER_HPP
+#define HTTP_PARSER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include "simd_scan.hpp"
+
+// -------------------------
+// Parsed Request
+// -------------------------
+// Every view points into the caller's receive buffer, so a request is only
+// valid until those bytes are consumed or moved.
+struct HttpHeader {
+    std::string_view name;
+    std::string_view value;
+};
+
+struct HttpRequest {
+    static constexpr size_t kMaxHeaders = 64;
+
+    std::string_view method;
+    std::string_view path;
+    std::string_view version;
+    std::array<HttpHeader, kMaxHeaders> headers;
+    size_t num_headers = 0;
+    size_t content_length = 0;
+    bool keep_alive = false;
+    bool chunked = false;
+
+    // Case-insensitive lookup; returns an empty view when the header is absent.
+    std::string_view header(std::string_view name) const;
+};
+
+// ASCII case-insensitive comparison. lower must already be lower-case.
+inline bool iequals(std::string_view text, std::string_view lower) {
+    if (text.size() != lower.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        if (c >= 'A' && c <= 'Z') {
+            c = static_cast<char>(c - 'A' + 'a');
+        }
+        if (c != lower[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// True if the comma-separated header value contains token (lower-case).
+inline bool header_has_token(std::string_view value, std::string_view token) {
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        std::string_view item = value.substr(0, comma);
+        while (!item.empty() && (item.front() == ' ' || item.front() == '\t')) {
+            item.remove_prefix(1);
+        }
+        while (!item.empty() && (item.back() == ' ' || item.back() == '\t')) {
+            item.remove_suffix(1);
+        }
+        if (iequals(item, token)) {
+            return true;
+        }
+        if (comma == std::string_view::npos) {
+            break;
+        }
+        value.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+inline std::string_view HttpRequest::header(std::string_view name) const {
+    for (size_t i = 0; i < num_headers; ++i) {
+        if (headers[i].name.size() == name.size() && iequals(headers[i].name, name)) {
+            return headers[i].value;
+        }
+    }
+    return {};
+}
+
+// -------------------------
+// HttpRequestParser Class
+// -------------------------
+// Resumable state machine over the request head (request line + headers).
+// Call parse() with the bytes received so far, always starting at the first
+// byte of the request; when more bytes arrive call it again with the longer
+// range and it picks up where it stopped. The buffer may be moved between
+// calls because progress is kept as offsets, and views are only produced
+// once the head is complete. Nothing is allocated.
+class HttpRequestParser {
+public:
+    enum class Result { complete, incomplete, error };
+
+    Result parse(const char *data, size_t size);
+
+    // Size of the request head (through the blank line) once complete.
+    size_t head_size() const { return pos_; }
+
+    const HttpRequest &request() const { return request_; }
+
+    void reset() {
+        state_ = State::method;
+        pos_ = 0;
+        num_headers_ = 0;
+        content_length_seen_ = false;
+        // The header array is left alone; num_headers bounds what is read.
+        request_.num_headers = 0;
+        request_.content_length = 0;
+        request_.keep_alive = false;
+        request_.chunked = false;
+    }
+
+private:
+    enum class State : uint8_t {
+        method,
+        path,
+        version,
+        request_line_lf,
+        header_start,
+        header_name,
+        header_value_start,
+        header_value,
+        header_lf,
+        head_lf
+    };
+
+    struct Span {
+        uint32_t begin = 0;
+        uint32_t end = 0;
+    };
+
+    // RFC 7230 tchar, one table lookup per byte.
+    struct TokenTable {
+        bool is_token[256] = {};
+        constexpr TokenTable() {
+            for (int c = '0'; c <= '9'; ++c) is_token[c] = true;
+            for (int c = 'a'; c <= 'z'; ++c) is_token[c] = true;
+            for (int c = 'A'; c <= 'Z'; ++c) is_token[c] = true;
+            const char extra[] = "!#$%&'*+-.^_`|~";
+            for (const char *p = extra; *p; ++p) {
+                is_token[static_cast<unsigned char>(*p)] = true;
+            }
+        }
+    };
+
+    static bool is_token_char(unsigned char c) {
+        static constexpr TokenTable table;
+        return table.is_token[c];
+    }
+
+    // Advance pos_ to the next delimiter using the SIMD scanner; the hot path
+    // for targets, header names and long header values.
+    void skip_to(const char *data, size_t size, size_t (*find_end)(const char *, size_t)) {
+        pos_ += find_end(data + pos_, size - pos_);
+    }
+
+    Result finish(const char *data);
+
+    State state_ = State::method;
+    size_t pos_ = 0;
+    Span method_;
+    Span path_;
+    Span version_;
+    std::array<Span, HttpRequest::kMaxHeaders * 2> header_spans_;
+    size_t num_headers_ = 0;
+    bool content_length_seen_ = false;
+    HttpRequest request_;
+};
+
+inline HttpRequestParser::Result HttpRequestParser::parse(const char *data, size_t size) {
+    while (pos_ < size) {
+        unsigned char c = static_cast<unsigned char>(data[pos_]);
+        switch (state_) {
+        case State::method:
+            if (c == ' ') {
+                if (pos_ == method_.begin) {
+                    return Result::error;
+                }
+                method_.end = static_cast<uint32_t>(pos_);
+                path_.begin = static_cast<uint32_t>(pos_ + 1);
+                state_ = State::path;
+            } else if (!is_token_char(c)) {
+                return Result::error;
+            }
+            break;
+        case State::path:
+            skip_to(data, size, simd_scan::find_target_end);
+            if (pos_ == size) {
+                return Result::incomplete;
+            }
+            c = static_cast<unsigned char>(data[pos_]);
+            if (c == ' ') {
+                if (pos_ == path_.begin) {
+                    return Result::error;
+                }
+                path_.end = static_cast<uint32_t>(pos_);
+                version_.begin = static_cast<uint32_t>(pos_ + 1);
+                state_ = State::version;
+            } else {
+                return Result::error;
+            }
+            break;
+        case State::version:
+            if (c == '\r' || c == '\n') {
+                version_.end = static_cast<uint32_t>(pos_);
+                state_ = (c == '\r') ? State::request_line_lf : State::header_start;
+            } else if (c < 0x21) {
+                return Result::error;
+            }
+            break;
+        case State::request_line_lf:
+            if (c != '\n') {
+                return Result::error;
+            }
+            state_ = State::header_start;
+            break;
+        case State::header_start:
+            if (c == '\r') {
+                state_ = State::head_lf;
+            } else if (c == '\n') {
+                ++pos_;
+                return finish(data);
+            } else if (is_token_char(c)) {
+                if (num_headers_ == HttpRequest::kMaxHeaders) {
+                    return Result::error;
+                }
+                header_spans_[num_headers_ * 2].begin = static_cast<uint32_t>(pos_);
+                state_ = State::header_name;
+            } else {
+                return Result::error;
+            }
+            break;
+        case State::header_name: {
+            // The scanner only stops at ':' and bytes that end any token, so
+            // the short name is then checked against the full tchar set.
+            size_t name_pos = pos_;
+            skip_to(data, size, simd_scan::find_name_end);
+            for (; name_pos < pos_; ++name_pos) {
+                if (!is_token_char(static_cast<unsigned char>(data[name_pos]))) {
+                    return Result::error;
+                }
+            }
+            if (pos_ == size) {
+                return Result::incomplete;
+            }
+            c = static_cast<unsigned char>(data[pos_]);
+            if (c == ':') {
+                header_spans_[num_headers_ * 2].end = static_cast<uint32_t>(pos_);
+                state_ = State::header_value_start;
+            } else {
+                return Result::error;
+            }
+            break;
+        }
+        case State::header_value_start:
+            if (c == ' ' || c == '\t') {
+                break;
+            }
+            header_spans_[num_headers_ * 2 + 1].begin = static_cast<uint32_t>(pos_);
+            state_ = State::header_value;
+            [[fallthrough]];
+        case State::header_value:
+            skip_to(data, size, simd_scan::find_value_end);
+            if (pos_ == size) {
+                return Result::incomplete;
+            }
+            c = static_cast<unsigned char>(data[pos_]);
+            if (c == '\r' || c == '\n') {
+                Span &value = header_spans_[num_headers_ * 2 + 1];
+                uint32_t end = static_cast<uint32_t>(pos_);
+                while (end > value.begin && (data[end - 1] == ' ' || data[end - 1] == '\t')) {
+                    --end;
+                }
+                value.end = end;
+                ++num_headers_;
+                state_ = (c == '\r') ? State::header_lf : State::header_start;
+            } else {
+                return Result::error;
+            }
+            break;
+        case State::header_lf:
+            if (c != '\n') {
+                return Result::error;
+            }
+            state_ = State::header_start;
+            break;
+        case State::head_lf:
+            if (c != '\n') {
+                return Result::error;
+            }
+            ++pos_;
+            return finish(data);
+        }
+        ++pos_;
+    }
+    return Result::incomplete;
+}
+
+// Turn the recorded offsets into views and interpret the headers the server
+// cares about.
+inline HttpRequestParser::Result HttpRequestParser::finish(const char *data) {
+    auto view = [data](Span span) {
+        return std::string_view(data + span.begin, span.end - span.begin);
+    };
+    request_.method = view(method_);
+    request_.path = view(path_);
+    request_.version = view(version_);
+    if (request_.version == "HTTP/1.1") {
+        request_.keep_alive = true;
+    } else if (request_.version == "HTTP/1.0") {
+        request_.keep_alive = false;
+    } else {
+        return Result::error;
+    }
+
+    request_.num_headers = num_headers_;
+    for (size_t i = 0; i < num_headers_; ++i) {
+        HttpHeader &header = request_.headers[i];
+        header.name = view(header_spans_[i * 2]);
+        header.value = view(header_spans_[i * 2 + 1]);
+
+        if (iequals(header.name, "content-length")) {
+            if (header.value.empty()) {
+                return Result::error;
+            }
+            size_t length = 0;
+            for (char c : header.value) {
+                if (c < '0' || c > '9' || length > (SIZE_MAX - 9) / 10) {
+                    return Result::error;
+                }
+                length = length * 10 + static_cast<size_t>(c - '0');
+            }
+            if (content_length_seen_ && length != request_.content_length) {
+                return Result::error;
+            }
+            content_length_seen_ = true;
+            request_.content_length = length;
+        } else if (iequals(header.name, "connection")) {
+            if (header_has_token(header.value, "close")) {
+                request_.keep_alive = false;
+            } else if (header_has_token(header.value, "keep-alive")) {
+                request_.keep_alive = true;
+            }
+        } else if (iequals(header.name, "transfer-encoding")) {
+            request_.chunked = true;
+        }
+    }
+    return Result::complete;
+}
+
+#endif // HTTP_PARSER_HPP
@@ -0,0 +1,215 @@
+// http_response.hpp
+#ifndef HTTP_RESPONSE_HPP
+#define HTTP_RESPONSE_HPP
+
+#include <boost/asio/buffer.hpp>
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <string_view>
+
+// -------------------------
+// Static Header Blocks
+// -------------------------
+// Header lines that never change between responses. They live in read-only
+// storage and go out as their own iovec, so they are never copied.
+namespace http_headers {
+
+inline constexpr std::string_view kCors =
+    "Access-Control-Allow-Origin: *\r\n"
+    "Access-Control-Allow-Methods: POST, OPTIONS\r\n"
+    "Access-Control-Allow-Headers: Content-Type\r\n";
+
+inline constexpr std::string_view kJson =
+    "Content-Type: application/json; charset=utf-8\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "Access-Control-Allow-Methods: POST, OPTIONS\r\n"
+    "Access-Control-Allow-Headers: Content-Type\r\n";
+
+// For 503 responses from load shedding: try again in a second.
+inline constexpr std::string_view kJsonRetryAfter =
+    "Retry-After: 1\r\n"
+    "Content-Type: application/json; charset=utf-8\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "Access-Control-Allow-Methods: POST, OPTIONS\r\n"
+    "Access-Control-Allow-Headers: Content-Type\r\n";
+
+inline constexpr std::string_view kKeepAlive = "Connection: keep-alive\r\n\r\n";
+inline constexpr std::string_view kClose = "Connection: close\r\n\r\n";
+
+inline std::string_view reason_phrase(int status_code) {
+    switch (status_code) {
+    case 200: return "OK";
+    case 204: return "No Content";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 408: return "Request Timeout";
+    case 413: return "Payload Too Large";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    default:  return "Unknown";
+    }
+}
+
+} // namespace http_headers
+
+// -------------------------
+// DateCache Class
+// -------------------------
+// The RFC 7231 IMF-fixdate header line, e.g.
+//   "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+// Each I/O thread keeps one and refreshes it once a second from a timer, so
+// requests only copy 37 bytes. Formatting is done by hand to stay independent
+// of the C locale.
+class DateCache {
+public:
+    static constexpr size_t kLineSize = 37;
+
+    DateCache() { refresh(); }
+
+    void refresh() {
+        time_t now = time(nullptr);
+        if (now == last_refresh_) {
+            return;
+        }
+        last_refresh_ = now;
+        static constexpr char kDays[] = "SunMonTueWedThuFriSat";
+        static constexpr char kMonths[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+        tm utc;
+        gmtime_r(&now, &utc);
+        char *out = line_;
+        auto put = [&out](const char *text, size_t size) {
+            std::memcpy(out, text, size);
+            out += size;
+        };
+        auto put2 = [&out](int value) {
+            *out++ = static_cast<char>('0' + value / 10);
+            *out++ = static_cast<char>('0' + value % 10);
+        };
+        put("Date: ", 6);
+        put(kDays + utc.tm_wday * 3, 3);
+        put(", ", 2);
+        put2(utc.tm_mday);
+        *out++ = ' ';
+        put(kMonths + utc.tm_mon * 3, 3);
+        *out++ = ' ';
+        int year = utc.tm_year + 1900;
+        put2(year / 100);
+        put2(year % 100);
+        *out++ = ' ';
+        put2(utc.tm_hour);
+        *out++ = ':';
+        put2(utc.tm_min);
+        *out++ = ':';
+        put2(utc.tm_sec);
+        put(" GMT\r\n", 6);
+    }
+
+    std::string_view line() const { return std::string_view(line_, kLineSize); }
+
+private:
+    char line_[kLineSize];
+    time_t last_refresh_ = 0;
+};
+
+// -------------------------
+// CannedResponse Class
+// -------------------------
+// A fixed response serialized once at startup. Everything but the Date line
+// is prebuilt, in a keep-alive and a close variant, so sending one is a
+// single gathered write of immutable buffers.
+class CannedResponse {
+public:
+    CannedResponse(int status_code, std::string_view header_block, std::string_view body) {
+        status_line_ = "HTTP/1.1 " + std::to_string(status_code) + " " +
+                       std::string(http_headers::reason_phrase(status_code)) + "\r\n";
+        std::string rest = std::string(header_block) +
+                           "Content-Length: " + std::to_string(body.size()) + "\r\n";
+        keep_alive_rest_ = rest + std::string(http_headers::kKeepAlive) + std::string(body);
+        close_rest_ = rest + std::string(http_headers::kClose) + std::string(body);
+    }
+
+    std::string_view status_line() const { return status_line_; }
+
+    // Everything after the Date line.
+    std::string_view rest(bool keep_alive) const {
+        return keep_alive ? keep_alive_rest_ : close_rest_;
+    }
+
+private:
+    std::string status_line_;
+    std::string keep_alive_rest_;
+    std::string close_rest_;
+};
+
+// -------------------------
+// ResponseWriter Class
+// -------------------------
+// Builds a response as a scatter-gather list for a single writev:
+//
+//   [status line + Date][static header block][Content-Length + Connection][body]
+//
+// Only the dynamic fields are written, into a small scratch area owned by the
+// connection: the status line and Content-Length with to_chars, and the Date
+// line copied from the thread's DateCache (copied because the cache may be
+// refreshed while a partial write is still pending). Everything else is
+// referenced in place. The returned buffers stay valid until the next build()
+// call and as long as the header block and body do.
+class ResponseWriter {
+public:
+    using Buffers = std::array<boost::asio::const_buffer, 4>;
+
+    Buffers build(int status_code, std::string_view header_block, std::string_view body,
+                  bool keep_alive, const DateCache &date) {
+        char *out = scratch_;
+        out = append(out, "HTTP/1.1 ");
+        out = std::to_chars(out, out + 3, status_code).ptr;
+        *out++ = ' ';
+        out = append(out, http_headers::reason_phrase(status_code));
+        out = append(out, "\r\n");
+        out = append(out, date.line());
+        size_t status_size = static_cast<size_t>(out - scratch_);
+
+        char *length_begin = out;
+        out = append(out, "Content-Length: ");
+        out = std::to_chars(out, scratch_ + sizeof(scratch_), body.size()).ptr;
+        out = append(out, "\r\n");
+        out = append(out, keep_alive ? http_headers::kKeepAlive : http_headers::kClose);
+
+        return {
+            boost::asio::buffer(scratch_, status_size),
+            boost::asio::buffer(header_block.data(), header_block.size()),
+            boost::asio::buffer(length_begin, static_cast<size_t>(out - length_begin)),
+            boost::asio::buffer(body.data(), body.size())
+        };
+    }
+
+    Buffers canned(const CannedResponse &response, bool keep_alive, const DateCache &date) {
+        char *out = append(scratch_, date.line());
+        std::string_view status_line = response.status_line();
+        std::string_view rest = response.rest(keep_alive);
+        return {
+            boost::asio::buffer(status_line.data(), status_line.size()),
+            boost::asio::buffer(scratch_, static_cast<size_t>(out - scratch_)),
+            boost::asio::buffer(rest.data(), rest.size()),
+            boost::asio::const_buffer()
+        };
+    }
+
+private:
+    static char *append(char *out, std::string_view text) {
+        std::memcpy(out, text.data(), text.size());
+        return out + text.size();
+    }
+
+    // Longest case: status line with the longest reason (~50 bytes), the Date
+    // line (37), a 20-digit Content-Length and the keep-alive line (~65).
+    char scratch_[192];
+};
+
+#endif // HTTP_RESPONSE_HPP
@@ -0,0 +1,235 @@
+// http_response_framer.hpp
+#ifndef HTTP_RESPONSE_FRAMER_HPP
+#define HTTP_RESPONSE_FRAMER_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include "http_parser.hpp"
+
+// -------------------------
+// HttpResponseFramer Class
+// -------------------------
+// Finds where each response ends on a persistent connection, for the load
+// generator: the body is delimited by Content-Length, by chunked transfer
+// coding, or, with neither, by the server closing the connection. Only the
+// status, the framing and the Connection header are looked at.
+//
+// feed() takes the bytes received and not yet consumed and consumes what
+// it can, up to the end of the response. The head, a chunk-size line and a
+// trailer line are only consumed whole, so a caller with a bounded buffer
+// keeps the unconsumed tail, appends what arrives next and feeds again;
+// body bytes are consumed as they come, so bodies need not fit the buffer.
+// Nothing is allocated.
+class HttpResponseFramer {
+public:
+    static constexpr size_t kMaxLine = 4096;  // chunk-size and trailer lines
+
+    // Returns the number of bytes consumed from the front of data.
+    size_t feed(const char *data, size_t size);
+
+    bool complete() const { return state_ == State::done; }
+    bool error() const { return state_ == State::error; }
+    // The body runs until the server closes; the response is complete at EOF.
+    bool until_eof() const { return state_ == State::until_eof; }
+    int status_code() const { return status_code_; }
+    // The server will take another request on this connection.
+    bool keep_alive() const { return keep_alive_ && state_ == State::done; }
+
+    void reset() {
+        state_ = State::head;
+        scanned_ = 0;
+        remaining_ = 0;
+        status_code_ = 0;
+        keep_alive_ = false;
+    }
+
+private:
+    enum class State : uint8_t { head, fixed_body, chunk_size, chunk_data, chunk_end, trailers, until_eof, done, error };
+
+    bool parse_head(std::string_view head);
+
+    State state_ = State::head;
+    size_t scanned_ = 0;      // head bytes already searched for the blank line
+    uint64_t remaining_ = 0;  // body or chunk bytes still to come
+    int status_code_ = 0;
+    bool keep_alive_ = false;
+};
+
+inline size_t HttpResponseFramer::feed(const char *data, size_t size) {
+    std::string_view input(data, size);
+    size_t pos = 0;
+    for (;;) {
+        switch (state_) {
+        case State::head: {
+            size_t end = input.find("\r\n\r\n", pos + (scanned_ > 3 ? scanned_ - 3 : 0));
+            if (end == std::string_view::npos) {
+                scanned_ = size - pos;
+                return pos;
+            }
+            if (!parse_head(input.substr(pos, end + 2 - pos))) {
+                state_ = State::error;
+                return pos;
+            }
+            pos = end + 4;
+            scanned_ = 0;
+            break;
+        }
+        case State::fixed_body: {
+            size_t take = static_cast<size_t>(std::min<uint64_t>(remaining_, size - pos));
+            pos += take;
+            remaining_ -= take;
+            if (remaining_ > 0) {
+                return pos;
+            }
+            state_ = State::done;
+            break;
+        }
+        case State::chunk_size: {
+            size_t eol = input.find("\r\n", pos);
+            if (eol == std::string_view::npos) {
+                if (size - pos > kMaxLine) {
+                    state_ = State::error;
+                }
+                return pos;
+            }
+            uint64_t length = 0;
+            size_t digits = 0;
+            for (size_t i = pos; i < eol && input[i] != ';' && input[i] != ' ' && input[i] != '\t'; ++i, ++digits) {
+                char c = input[i];
+                int value = c >= '0' && c <= '9' ? c - '0'
+                          : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                          : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+                if (value < 0 || length > (UINT64_MAX >> 4)) {
+                    state_ = State::error;
+                    return pos;
+                }
+                length = length * 16 + static_cast<uint64_t>(value);
+            }
+            if (digits == 0) {
+                state_ = State::error;
+                return pos;
+            }
+            pos = eol + 2;
+            remaining_ = length;
+            state_ = length == 0 ? State::trailers : State::chunk_data;
+            break;
+        }
+        case State::chunk_data: {
+            size_t take = static_cast<size_t>(std::min<uint64_t>(remaining_, size - pos));
+            pos += take;
+            remaining_ -= take;
+            if (remaining_ > 0) {
+                return pos;
+            }
+            state_ = State::chunk_end;
+            break;
+        }
+        case State::chunk_end:
+            if (size - pos < 2) {
+                return pos;
+            }
+            if (input[pos] != '\r' || input[pos + 1] != '\n') {
+                state_ = State::error;
+                return pos;
+            }
+            pos += 2;
+            state_ = State::chunk_size;
+            break;
+        case State::trailers: {
+            size_t eol = input.find("\r\n", pos);
+            if (eol == std::string_view::npos) {
+                if (size - pos > kMaxLine) {
+                    state_ = State::error;
+                }
+                return pos;
+            }
+            state_ = eol == pos ? State::done : State::trailers;
+            pos = eol + 2;
+            break;
+        }
+        case State::until_eof:
+            return size;
+        case State::done:
+        case State::error:
+            return pos;
+        }
+    }
+}
+
+// Status line and the headers that decide framing and reuse.
+inline bool HttpResponseFramer::parse_head(std::string_view head) {
+    size_t eol = head.find("\r\n");
+    std::string_view status_line = head.substr(0, eol);
+    if (status_line.size() < 12 || status_line.substr(0, 7) != "HTTP/1." || status_line[8] != ' ') {
+        return false;
+    }
+    keep_alive_ = status_line[7] == '1';
+    status_code_ = 0;
+    for (size_t i = 9; i < 12; ++i) {
+        if (status_line[i] < '0' || status_line[i] > '9') {
+            return false;
+        }
+        status_code_ = status_code_ * 10 + (status_line[i] - '0');
+    }
+
+    bool has_length = false;
+    bool chunked = false;
+    uint64_t length = 0;
+    for (size_t pos = eol + 2; pos < head.size();) {
+        size_t end = head.find("\r\n", pos);
+        std::string_view line = head.substr(pos, end - pos);
+        pos = end + 2;
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos) {
+            return false;
+        }
+        std::string_view name = line.substr(0, colon);
+        std::string_view value = line.substr(colon + 1);
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+            value.remove_prefix(1);
+        }
+        while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+            value.remove_suffix(1);
+        }
+        if (iequals(name, "content-length")) {
+            if (value.empty()) {
+                return false;
+            }
+            length = 0;
+            for (char c : value) {
+                if (c < '0' || c > '9' || length > (UINT64_MAX - 9) / 10) {
+                    return false;
+                }
+                length = length * 10 + static_cast<uint64_t>(c - '0');
+            }
+            has_length = true;
+        } else if (iequals(name, "transfer-encoding")) {
+            chunked = header_has_token(value, "chunked");
+        } else if (iequals(name, "connection")) {
+            if (header_has_token(value, "close")) {
+                keep_alive_ = false;
+            } else if (header_has_token(value, "keep-alive")) {
+                keep_alive_ = true;
+            }
+        }
+    }
+
+    // 1xx, 204 and 304 never have a body; after a 1xx the real response
+    // follows. Chunked wins over Content-Length.
+    if ((status_code_ >= 100 && status_code_ < 200) || status_code_ == 204 || status_code_ == 304) {
+        state_ = status_code_ < 200 ? State::head : State::done;
+    } else if (chunked) {
+        state_ = State::chunk_size;
+    } else if (has_length) {
+        remaining_ = length;
+        state_ = State::fixed_body;
+    } else {
+        keep_alive_ = false;
+        state_ = State::until_eof;
+    }
+    return true;
+}
+
+#endif // HTTP_RESPONSE_FRAMER_HPP
@@ -0,0 +1,175 @@
+// huge_pages.hpp
+#ifndef HUGE_PAGES_HPP
+#define HUGE_PAGES_HPP
+
+#include <sys/mman.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+// -------------------------
+// Huge Page Mappings
+// -------------------------
+// Anonymous memory for buffer pools, optionally on 2 MiB pages so that a
+// pool of thousands of buffers needs a handful of TLB entries instead of one
+// per 4 KiB page. hugetlb asks for reserved huge pages (vm.nr_hugepages) with
+// MAP_HUGETLB; thp asks for transparent huge pages with madvise, which the
+// kernel may or may not honour. Either falls back to the next option when
+// refused, and every mapping is counted by what it actually got.
+namespace huge_pages {
+
+inline constexpr size_t kHugePageSize = size_t(2) << 20;
+
+enum class Mode { off, thp, hugetlb };
+enum class Backing { small_pages, thp, hugetlb };
+
+inline const char *mode_name(Mode mode) {
+    switch (mode) {
+    case Mode::off:     return "off";
+    case Mode::thp:     return "thp";
+    case Mode::hugetlb: return "hugetlb";
+    }
+    return "unknown";
+}
+
+inline const char *backing_name(Backing backing) {
+    switch (backing) {
+    case Backing::small_pages: return "small_pages";
+    case Backing::thp:         return "thp";
+    case Backing::hugetlb:     return "hugetlb";
+    }
+    return "unknown";
+}
+
+inline Mode parse_mode(const std::string &text) {
+    if (text == "off") {
+        return Mode::off;
+    }
+    if (text == "thp") {
+        return Mode::thp;
+    }
+    if (text == "hugetlb") {
+        return Mode::hugetlb;
+    }
+    throw std::invalid_argument("unknown huge page mode: " + text);
+}
+
+// Written by one thread, read by any; relaxed atomics.
+struct Counters {
+    std::atomic<size_t> hugetlb_mappings{0};
+    std::atomic<size_t> thp_mappings{0};
+    std::atomic<size_t> small_page_mappings{0};
+    // Mappings that asked for huge pages and got a weaker backing.
+    std::atomic<size_t> fallbacks{0};
+    std::atomic<size_t> mapped_bytes{0};
+};
+
+// An owned anonymous mapping.
+class Mapping {
+public:
+    Mapping() = default;
+    Mapping(void *base, size_t mapped_size, char *data, size_t size, Backing backing)
+        : base_(base), mapped_size_(mapped_size), data_(data), size_(size), backing_(backing) {}
+
+    ~Mapping() {
+        if (base_) {
+            munmap(base_, mapped_size_);
+        }
+    }
+
+    Mapping(Mapping &&other) noexcept { *this = std::move(other); }
+
+    Mapping &operator=(Mapping &&other) noexcept {
+        std::swap(base_, other.base_);
+        std::swap(mapped_size_, other.mapped_size_);
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(backing_, other.backing_);
+        return *this;
+    }
+
+    char *data() const { return data_; }
+    size_t size() const { return size_; }
+    Backing backing() const { return backing_; }
+
+private:
+    void *base_ = nullptr;
+    size_t mapped_size_ = 0;
+    char *data_ = nullptr;
+    size_t size_ = 0;
+    Backing backing_ = Backing::small_pages;
+};
+
+inline size_t round_up(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+inline void *map_anonymous(size_t size, int extra_flags) {
+    return mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | extra_flags, -1, 0);
+}
+
+inline void bump(std::atomic<size_t> &counter, size_t amount) {
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+// Map at least size bytes. In the huge page modes the size is rounded up to
+// whole 2 MiB pages and the start is 2 MiB aligned (THP can only back
+// aligned ranges). Throws std::bad_alloc if even small pages are refused.
+inline Mapping map(size_t size, Mode mode, Counters *counters = nullptr) {
+    auto count = [counters](std::atomic<size_t> Counters::*mappings, size_t bytes) {
+        if (counters) {
+            bump(counters->*mappings, 1);
+            bump(counters->mapped_bytes, bytes);
+        }
+    };
+    auto fallback = [counters]() {
+        if (counters) {
+            bump(counters->fallbacks, 1);
+        }
+    };
+
+    if (mode == Mode::off) {
+        void *p = map_anonymous(size, 0);
+        if (p == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        count(&Counters::small_page_mappings, size);
+        return Mapping(p, size, static_cast<char *>(p), size, Backing::small_pages);
+    }
+
+    size = round_up(size, kHugePageSize);
+    if (mode == Mode::hugetlb) {
+        void *p = map_anonymous(size, MAP_HUGETLB);
+        if (p != MAP_FAILED) {
+            count(&Counters::hugetlb_mappings, size);
+            return Mapping(p, size, static_cast<char *>(p), size, Backing::hugetlb);
+        }
+        fallback();
+    }
+
+    // Over-map by one huge page so an aligned range fits, then ask for THP.
+    size_t mapped_size = size + kHugePageSize;
+    void *p = map_anonymous(mapped_size, 0);
+    if (p == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    auto address = reinterpret_cast<uintptr_t>(p);
+    char *aligned = reinterpret_cast<char *>(round_up(address, kHugePageSize));
+    if (madvise(aligned, size, MADV_HUGEPAGE) == 0) {
+        count(&Counters::thp_mappings, size);
+        return Mapping(p, mapped_size, aligned, size, Backing::thp);
+    }
+    if (mode == Mode::thp) {
+        fallback();
+    }
+    count(&Counters::small_page_mappings, size);
+    return Mapping(p, mapped_size, aligned, size, Backing::small_pages);
+}
+
+} // namespace huge_pages
+
+#endif // HUGE_PAGES_HPP
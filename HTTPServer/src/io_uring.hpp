@@ -0,0 +1,586 @@
+// io_uring.hpp
+#ifndef IO_URING_HPP
+#define IO_URING_HPP
+
+// Minimal io_uring bindings on top of the raw syscalls, so the server does
+// not need liburing. Only what the io_uring backend uses is wrapped: ring
+// setup, SQE preparation, provided-buffer rings and CQE iteration.
+// IO_URING_AVAILABLE is 0 when the kernel headers are too old for multishot
+// accept and provided-buffer rings (Linux 5.19); the backend then reports
+// itself unsupported and the server falls back to Boost.Asio.
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+
+#if defined(IORING_ACCEPT_MULTISHOT) && defined(IORING_CQE_F_MORE)
+#define IO_URING_AVAILABLE 1
+#else
+#define IO_URING_AVAILABLE 0
+#endif
+
+#if IO_URING_AVAILABLE
+
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace uring {
+
+inline int sys_setup(unsigned entries, io_uring_params *params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+inline int sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+inline int sys_register(int fd, unsigned opcode, const void *arg, unsigned nr_args) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+inline std::system_error errno_error(const std::string &what) {
+    return std::system_error(errno, std::generic_category(), what);
+}
+
+// -------------------------
+// Ring Class
+// -------------------------
+// One submission/completion queue pair, owned by a single thread.
+class Ring {
+public:
+    explicit Ring(unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        fd_ = sys_setup(entries, &params);
+        if (fd_ < 0) {
+            throw errno_error("io_uring_setup");
+        }
+        try {
+            map_rings(params);
+        } catch (...) {
+            unmap();
+            close(fd_);
+            throw;
+        }
+    }
+
+    ~Ring() {
+        unmap();
+        close(fd_);
+    }
+
+    Ring(const Ring &) = delete;
+    Ring &operator=(const Ring &) = delete;
+
+    int fd() const { return fd_; }
+
+    // Next free SQE, zeroed; submits pending entries first if the queue is full.
+    io_uring_sqe *get_sqe() {
+        unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        if (sqe_tail_ - head >= sq_entries_) {
+            submit(0);
+            head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+            if (sqe_tail_ - head >= sq_entries_) {
+                throw std::runtime_error("io_uring submission queue full");
+            }
+        }
+        io_uring_sqe *sqe = &sqes_[sqe_tail_ & sq_mask_];
+        ++sqe_tail_;
+        std::memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    // Publish queued SQEs and optionally wait for completions; one syscall.
+    void submit(unsigned wait_nr) {
+        __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+        unsigned to_submit = sqe_tail_ - submitted_;
+        if (to_submit == 0 && wait_nr == 0) {
+            return;
+        }
+        unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+        int ret;
+        do {
+            ret = sys_enter(fd_, to_submit, wait_nr, flags);
+        } while (ret < 0 && errno == EINTR);
+        ++enter_calls_;
+        if (ret < 0 && errno != EBUSY && errno != EAGAIN) {
+            throw errno_error("io_uring_enter");
+        }
+        if (ret > 0) {
+            submitted_ += static_cast<unsigned>(ret);
+        }
+    }
+
+    // Call f(cqe) for every ready completion, then release them to the kernel.
+    template <typename F>
+    unsigned for_each_cqe(F &&f) {
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        unsigned count = 0;
+        for (; head != tail; ++head, ++count) {
+            f(cqes_[head & cq_mask_]);
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+    size_t enter_calls() const { return enter_calls_; }
+
+private:
+    void map_rings(const io_uring_params &params) {
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        }
+        sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        fd_, IORING_OFF_SQ_RING);
+        if (sq_ring_ == MAP_FAILED) {
+            sq_ring_ = nullptr;
+            throw errno_error("mmap sq ring");
+        }
+        if (single_mmap) {
+            cq_ring_ = sq_ring_;
+        } else {
+            cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            fd_, IORING_OFF_CQ_RING);
+            if (cq_ring_ == MAP_FAILED) {
+                cq_ring_ = nullptr;
+                throw errno_error("mmap cq ring");
+            }
+        }
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        void *sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            throw errno_error("mmap sqes");
+        }
+        sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+        auto *sq = static_cast<char *>(sq_ring_);
+        sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sq_entries_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_entries);
+        // SQE slots are used in order, so the index array is the identity.
+        auto *array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        for (unsigned i = 0; i < sq_entries_; ++i) {
+            array[i] = i;
+        }
+        sqe_tail_ = submitted_ = *sq_tail_;
+
+        auto *cq = static_cast<char *>(cq_ring_);
+        cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    }
+
+    void unmap() {
+        if (sqes_) {
+            munmap(sqes_, sqes_size_);
+        }
+        if (cq_ring_ && cq_ring_ != sq_ring_) {
+            munmap(cq_ring_, cq_ring_size_);
+        }
+        if (sq_ring_) {
+            munmap(sq_ring_, sq_ring_size_);
+        }
+    }
+
+    int fd_ = -1;
+    void *sq_ring_ = nullptr;
+    void *cq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    size_t cq_ring_size_ = 0;
+    io_uring_sqe *sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    unsigned *sq_head_ = nullptr;
+    unsigned *sq_tail_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned sqe_tail_ = 0;
+    unsigned submitted_ = 0;
+
+    unsigned *cq_head_ = nullptr;
+    unsigned *cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe *cqes_ = nullptr;
+
+    size_t enter_calls_ = 0;
+};
+
+// -------------------------
+// SQE Preparation
+// -------------------------
+inline void prep_rw(io_uring_sqe *sqe, uint8_t opcode, int fd, const void *addr,
+                    unsigned len, uint64_t offset, uint64_t user_data) {
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(addr);
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+}
+
+// One SQE that keeps producing a CQE per accepted connection until it fails
+// or the CQE arrives without IORING_CQE_F_MORE.
+inline void prep_multishot_accept(io_uring_sqe *sqe, int listen_fd, uint64_t user_data) {
+    prep_rw(sqe, IORING_OP_ACCEPT, listen_fd, nullptr, 0, 0, user_data);
+    sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+}
+
+// Receive into whichever buffer of the group the kernel picks.
+inline void prep_recv_select(io_uring_sqe *sqe, int fd, uint16_t group_id, unsigned len, uint64_t user_data) {
+    prep_rw(sqe, IORING_OP_RECV, fd, nullptr, len, 0, user_data);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = group_id;
+}
+
+inline void prep_sendmsg(io_uring_sqe *sqe, int fd, const msghdr *msg, unsigned flags, uint64_t user_data) {
+    prep_rw(sqe, IORING_OP_SENDMSG, fd, msg, 1, 0, user_data);
+    sqe->msg_flags = flags;
+}
+
+inline void prep_close(io_uring_sqe *sqe, int fd, uint64_t user_data) {
+    prep_rw(sqe, IORING_OP_CLOSE, fd, nullptr, 0, 0, user_data);
+}
+
+inline void prep_shutdown(io_uring_sqe *sqe, int fd, int how, uint64_t user_data) {
+    prep_rw(sqe, IORING_OP_SHUTDOWN, fd, nullptr, static_cast<unsigned>(how), 0, user_data);
+}
+
+inline void prep_read(io_uring_sqe *sqe, int fd, void *buffer, unsigned len, uint64_t user_data) {
+    prep_rw(sqe, IORING_OP_READ, fd, buffer, len, 0, user_data);
+}
+
+inline void prep_timeout(io_uring_sqe *sqe, const __kernel_timespec *ts, uint64_t user_data) {
+    prep_rw(sqe, IORING_OP_TIMEOUT, -1, ts, 1, 0, user_data);
+}
+
+// Cancels the linked SQE before it if that has not completed within ts.
+inline void prep_link_timeout(io_uring_sqe *sqe, const __kernel_timespec *ts, uint64_t user_data) {
+    prep_rw(sqe, IORING_OP_LINK_TIMEOUT, -1, ts, 1, 0, user_data);
+}
+
+// Cancels the in-flight request whose user_data is target, if there is one.
+inline void prep_cancel(io_uring_sqe *sqe, uint64_t target, uint64_t user_data) {
+    prep_rw(sqe, IORING_OP_ASYNC_CANCEL, -1, reinterpret_cast<const void *>(target), 0, 0, user_data);
+}
+
+inline uint16_t cqe_buffer_id(const io_uring_cqe &cqe) {
+    return static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+}
+
+inline bool ring_mapped_buffers_work();
+
+// -------------------------
+// BufferRing Class
+// -------------------------
+// A group of provided buffers: the kernel picks a free buffer when a receive
+// completes instead of every connection pinning its own. Buffers go back to
+// the group with recycle() once their bytes have been consumed.
+//
+// The group is a ring-mapped buffer ring where that works; some kernels
+// register one but never hand out its buffers, and there the buffers are
+// provided with IORING_OP_PROVIDE_BUFFERS instead (one SQE per recycle, with
+// user_data 0, batched into the next submit).
+//
+// The buffers themselves are entries * buffer_size bytes of storage the
+// caller may supply (for instance from huge pages); otherwise they are
+// allocated here.
+class BufferRing {
+public:
+    BufferRing(Ring &ring, uint16_t group_id, unsigned entries, size_t buffer_size, char *storage = nullptr)
+        : BufferRing(ring, group_id, entries, buffer_size, ring_mapped_buffers_work(), storage) {}
+
+    BufferRing(Ring &ring, uint16_t group_id, unsigned entries, size_t buffer_size, bool ring_mapped,
+               char *storage = nullptr)
+        : ring_(ring), group_id_(group_id), entries_(entries), mask_(entries - 1),
+          buffer_size_(buffer_size), ring_mapped_(ring_mapped) {
+        if (entries == 0 || (entries & (entries - 1)) != 0 || entries > 32768) {
+            throw std::invalid_argument("buffer ring size must be a power of two <= 32768");
+        }
+        buffers_ = storage ? storage : (owned_buffers_ = new char[entries * buffer_size]);
+        if (!ring_mapped_) {
+            provide(0, entries);
+            return;
+        }
+        ring_size_ = entries * sizeof(io_uring_buf);
+        void *ring_memory = mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ring_memory == MAP_FAILED) {
+            delete[] owned_buffers_;
+            throw errno_error("mmap buffer ring");
+        }
+        buf_ring_ = static_cast<io_uring_buf_ring *>(ring_memory);
+
+        io_uring_buf_reg reg;
+        std::memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring_);
+        reg.ring_entries = entries;
+        reg.bgid = group_id;
+        if (sys_register(ring.fd(), IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+            auto error = errno_error("IORING_REGISTER_PBUF_RING");
+            munmap(buf_ring_, ring_size_);
+            delete[] owned_buffers_;
+            throw error;
+        }
+
+        for (unsigned i = 0; i < entries; ++i) {
+            add(static_cast<uint16_t>(i), i);
+        }
+        publish(entries);
+    }
+
+    ~BufferRing() {
+        delete[] owned_buffers_;
+        if (!ring_mapped_) {
+            return;
+        }
+        io_uring_buf_reg reg;
+        std::memset(&reg, 0, sizeof(reg));
+        reg.bgid = group_id_;
+        sys_register(ring_.fd(), IORING_UNREGISTER_PBUF_RING, &reg, 1);
+        munmap(buf_ring_, ring_size_);
+    }
+
+    BufferRing(const BufferRing &) = delete;
+    BufferRing &operator=(const BufferRing &) = delete;
+
+    uint16_t group_id() const { return group_id_; }
+    size_t buffer_size() const { return buffer_size_; }
+    bool ring_mapped() const { return ring_mapped_; }
+
+    const char *buffer(uint16_t buffer_id) const {
+        return buffers_ + static_cast<size_t>(buffer_id) * buffer_size_;
+    }
+
+    void recycle(uint16_t buffer_id) {
+        if (!ring_mapped_) {
+            provide(buffer_id, 1);
+            return;
+        }
+        add(buffer_id, 0);
+        publish(1);
+    }
+
+private:
+    void provide(uint16_t first_id, unsigned count) {
+        io_uring_sqe *sqe = ring_.get_sqe();
+        prep_rw(sqe, IORING_OP_PROVIDE_BUFFERS, static_cast<int>(count), buffer(first_id),
+                static_cast<unsigned>(buffer_size_), first_id, 0);
+        sqe->buf_group = group_id_;
+    }
+
+    void add(uint16_t buffer_id, unsigned offset) {
+        io_uring_buf &buf = buf_ring_->bufs[(tail_ + offset) & mask_];
+        buf.addr = reinterpret_cast<uint64_t>(buffer(buffer_id));
+        buf.len = static_cast<uint32_t>(buffer_size_);
+        buf.bid = buffer_id;
+    }
+
+    void publish(unsigned count) {
+        tail_ = static_cast<uint16_t>(tail_ + count);
+        __atomic_store_n(&buf_ring_->tail, tail_, __ATOMIC_RELEASE);
+    }
+
+    Ring &ring_;
+    uint16_t group_id_;
+    unsigned entries_;
+    unsigned mask_;
+    size_t buffer_size_;
+    bool ring_mapped_;
+    size_t ring_size_ = 0;
+    io_uring_buf_ring *buf_ring_ = nullptr;
+    char *buffers_ = nullptr;
+    char *owned_buffers_ = nullptr;
+    uint16_t tail_ = 0;
+};
+
+// -------------------------
+// Kernel Probes
+// -------------------------
+// Submit what is queued and wait until count more completions have been
+// passed to f.
+template <typename F>
+inline void wait_cqes(Ring &ring, unsigned count, F &&f) {
+    while (count > 0) {
+        ring.submit(1);
+        count -= std::min(count, ring.for_each_cqe(f));
+    }
+}
+
+// Receive one byte over a socketpair into a buffer the kernel picks from a
+// group, either a registered buffer ring or buffers provided by SQE.
+inline bool buffer_select_works(bool ring_mapped) {
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) < 0) {
+        return false;
+    }
+    bool received = false;
+    try {
+        Ring ring(8);
+        BufferRing buffers(ring, 0, 8, 64, ring_mapped);
+        if (write(sockets[1], "x", 1) == 1) {
+            prep_recv_select(ring.get_sqe(), sockets[0], buffers.group_id(), 64, 1);
+            wait_cqes(ring, ring_mapped ? 1 : 2, [&received](const io_uring_cqe &cqe) {
+                if (cqe.user_data == 1) {
+                    received = cqe.res == 1 && (cqe.flags & IORING_CQE_F_BUFFER);
+                }
+            });
+        }
+    } catch (const std::exception &) {
+    }
+    close(sockets[0]);
+    close(sockets[1]);
+    return received;
+}
+
+// Checked once per process.
+inline bool ring_mapped_buffers_work() {
+    static const bool works = buffer_select_works(true);
+    return works;
+}
+
+// Every opcode the io_uring backend submits, by IORING_REGISTER_PROBE.
+inline bool opcodes_supported(Ring &ring) {
+    static constexpr uint8_t kUsed[] = {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG,
+                                        IORING_OP_CLOSE, IORING_OP_SHUTDOWN, IORING_OP_READ,
+                                        IORING_OP_TIMEOUT, IORING_OP_LINK_TIMEOUT, IORING_OP_ASYNC_CANCEL,
+                                        IORING_OP_PROVIDE_BUFFERS};
+    size_t size = sizeof(io_uring_probe) + IORING_OP_LAST * sizeof(io_uring_probe_op);
+    std::vector<uint64_t> memory((size + sizeof(uint64_t) - 1) / sizeof(uint64_t), 0);
+    auto *probe = reinterpret_cast<io_uring_probe *>(memory.data());
+    if (sys_register(ring.fd(), IORING_REGISTER_PROBE, probe, IORING_OP_LAST) < 0) {
+        return false;
+    }
+    for (uint8_t op : kUsed) {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A multishot accept on a throwaway loopback listener takes a connection
+// and stays armed (Linux 5.19; older kernels fail it with -EINVAL), and
+// cancelling it, as a drain does, ends it.
+inline bool multishot_accept_works() {
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int client = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    bool works = false;
+    try {
+        sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(addr);
+        if (listener < 0 || client < 0 || bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+            listen(listener, 1) < 0 || getsockname(listener, reinterpret_cast<sockaddr *>(&addr), &length) < 0) {
+            throw errno_error("probe listener");
+        }
+        Ring ring(8);
+        prep_multishot_accept(ring.get_sqe(), listener, 1);
+        ring.submit(0);
+        if (connect(client, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0) {
+            wait_cqes(ring, 1, [&works](const io_uring_cqe &cqe) {
+                works = cqe.res >= 0 && (cqe.flags & IORING_CQE_F_MORE);
+                if (cqe.res >= 0) {
+                    close(cqe.res);
+                }
+            });
+        }
+        if (works) {
+            bool cancelled = false;
+            prep_cancel(ring.get_sqe(), 1, 2);
+            wait_cqes(ring, 2, [&cancelled](const io_uring_cqe &cqe) {
+                if (cqe.user_data == 2) {
+                    cancelled = cqe.res == 0;
+                }
+            });
+            works = cancelled;
+        }
+    } catch (const std::exception &) {
+        works = false;
+    }
+    if (client >= 0) {
+        close(client);
+    }
+    if (listener >= 0) {
+        close(listener);
+    }
+    return works;
+}
+
+// A sendmsg linked to a close, as a response that ends its connection is
+// sent: both complete, in order.
+inline bool linked_close_works() {
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) < 0) {
+        return false;
+    }
+    int sent = -1;
+    int closed = -1;
+    try {
+        Ring ring(8);
+        char byte = 'x';
+        iovec iov{&byte, 1};
+        msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        io_uring_sqe *sqe = ring.get_sqe();
+        prep_sendmsg(sqe, sockets[1], &msg, MSG_NOSIGNAL, 1);
+        sqe->flags |= IOSQE_IO_LINK;
+        prep_close(ring.get_sqe(), sockets[1], 2);
+        wait_cqes(ring, 2, [&](const io_uring_cqe &cqe) {
+            (cqe.user_data == 1 ? sent : closed) = cqe.res;
+        });
+    } catch (const std::exception &) {
+    }
+    close(sockets[0]);
+    if (closed != 0) {
+        close(sockets[1]);
+    }
+    return sent == 1 && closed == 0;
+}
+
+// Whether this kernel runs everything the io_uring backend relies on, not
+// just io_uring_setup (which sysctl or seccomp can also refuse): every
+// opcode it submits, multishot accept and its cancellation, receives into
+// provided buffers and linked sendmsg and close. A kernel with io_uring but
+// without these would otherwise be picked and fail every accept. Checked
+// once per process.
+inline bool kernel_supported() {
+    static const bool supported = []() {
+        try {
+            Ring ring(8);
+            return opcodes_supported(ring) && multishot_accept_works() &&
+                   (ring_mapped_buffers_work() || buffer_select_works(false)) && linked_close_works();
+        } catch (const std::exception &) {
+            return false;
+        }
+    }();
+    return supported;
+}
+
+} // namespace uring
+
+#endif // IO_URING_AVAILABLE
+
+#endif // IO_URING_HPP
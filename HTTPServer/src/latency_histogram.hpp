@@ -0,0 +1,217 @@
+// latency_histogram.hpp
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// -------------------------
+// Log-Linear Buckets
+// -------------------------
+// Values below 2^bits get a bucket each; above that, every power of two is
+// split into 2^bits linear sub-buckets, so a bucket is never wider than
+// 1/2^bits of the values in it.
+namespace log_linear {
+
+inline size_t bucket_index(uint64_t value, unsigned bits) {
+    const uint64_t sub_buckets = uint64_t(1) << bits;
+    if (value < sub_buckets) {
+        return static_cast<size_t>(value);
+    }
+    unsigned exponent = 63 - static_cast<unsigned>(__builtin_clzll(value));
+    unsigned shift = exponent - bits;
+    uint64_t sub_bucket = (value >> shift) - sub_buckets;
+    return static_cast<size_t>(sub_buckets + shift * sub_buckets + sub_bucket);
+}
+
+// Largest value that maps to bucket index.
+inline uint64_t bucket_upper_bound(size_t index, unsigned bits) {
+    const uint64_t sub_buckets = uint64_t(1) << bits;
+    if (index < sub_buckets) {
+        return index;
+    }
+    unsigned shift = static_cast<unsigned>((index - sub_buckets) / sub_buckets);
+    uint64_t sub_bucket = (index - sub_buckets) % sub_buckets;
+    uint64_t lower = (sub_buckets + sub_bucket) << shift;
+    return lower + ((uint64_t(1) << shift) - 1);
+}
+
+} // namespace log_linear
+
+// -------------------------
+// LatencyHistogram Class
+// -------------------------
+// Log-linear histogram of nanosecond values: every power of two is split into
+// 16 linear sub-buckets, so any recorded value is known to within ~6% with a
+// fixed 8 KB of counters and no allocation. It has a single writer (the
+// thread that owns it); other threads may read it at any time, so counters
+// are relaxed atomics updated with a plain load and store.
+class LatencyHistogram {
+public:
+    static constexpr unsigned kSubBucketBits = 4;
+    static constexpr uint64_t kSubBuckets = uint64_t(1) << kSubBucketBits;
+    static constexpr size_t kBuckets = kSubBuckets + (64 - kSubBucketBits) * kSubBuckets;
+
+    void record(uint64_t value) {
+        bump(buckets_[bucket_index(value)], 1);
+        bump(count_, 1);
+        bump(sum_, value);
+        if (value > max_.load(std::memory_order_relaxed)) {
+            max_.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    // Add another histogram's counts; for merging per-thread histograms into
+    // a local snapshot, not for a histogram that is being recorded into.
+    void merge(const LatencyHistogram &other) {
+        for (size_t i = 0; i < kBuckets; ++i) {
+            bump(buckets_[i], other.buckets_[i].load(std::memory_order_relaxed));
+        }
+        bump(count_, other.count());
+        bump(sum_, other.sum_.load(std::memory_order_relaxed));
+        if (other.max() > max()) {
+            max_.store(other.max(), std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+    double mean() const {
+        uint64_t n = count();
+        return n ? static_cast<double>(sum_.load(std::memory_order_relaxed)) / static_cast<double>(n) : 0.0;
+    }
+
+    // Smallest bucket upper bound with at least percentile% of the values at
+    // or below it, capped at the recorded maximum.
+    uint64_t value_at_percentile(double percentile) const {
+        uint64_t total = count();
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(total) + 0.5);
+        if (rank == 0) {
+            rank = 1;
+        }
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            seen += buckets_[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                uint64_t upper = bucket_upper_bound(i);
+                return upper < max() ? upper : max();
+            }
+        }
+        return max();
+    }
+
+    static size_t bucket_index(uint64_t value) {
+        return log_linear::bucket_index(value, kSubBucketBits);
+    }
+
+    // Largest value that maps to bucket index.
+    static uint64_t bucket_upper_bound(size_t index) {
+        return log_linear::bucket_upper_bound(index, kSubBucketBits);
+    }
+
+private:
+    static void bump(std::atomic<uint64_t> &counter, uint64_t amount) {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    std::array<std::atomic<uint64_t>, kBuckets> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+};
+
+// -------------------------
+// HdrHistogram Class
+// -------------------------
+// The same buckets with the precision chosen at run time, for recording a
+// long series of values on one thread and merging the threads' histograms
+// afterwards, as the load generator does. 1, 2 or 3 significant digits keep
+// every value to within 10%, 1% or 0.1% (4, 7 or 10 sub-bucket bits).
+// Buckets stop at highest_trackable: larger values are counted in the top
+// bucket, though max() stays exact. The counters are allocated once, when
+// the histogram is made, so memory does not grow with the run: with two
+// digits and values up to an hour in nanoseconds, 4,608 buckets in 36 KB.
+// Not thread-safe.
+class HdrHistogram {
+public:
+    static constexpr uint64_t kHourNs = uint64_t(3600) * 1000000000;
+
+    explicit HdrHistogram(int significant_digits = 2, uint64_t highest_trackable = kHourNs)
+        : significant_digits_(significant_digits) {
+        if (significant_digits < 1 || significant_digits > 3) {
+            throw std::invalid_argument("significant digits must be 1, 2 or 3");
+        }
+        bits_ = static_cast<unsigned>(std::ceil(significant_digits * std::log2(10.0)));
+        counts_.assign(log_linear::bucket_index(highest_trackable, bits_) + 1, 0);
+    }
+
+    void record(uint64_t value) {
+        size_t index = log_linear::bucket_index(value, bits_);
+        ++counts_[index < counts_.size() ? index : counts_.size() - 1];
+        ++count_;
+        sum_ += value;
+        min_ = value < min_ ? value : min_;
+        max_ = value > max_ ? value : max_;
+    }
+
+    // other must have the same precision and range.
+    void merge(const HdrHistogram &other) {
+        if (other.bits_ != bits_ || other.counts_.size() != counts_.size()) {
+            throw std::invalid_argument("merging histograms of different layouts");
+        }
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        count_ += other.count_;
+        sum_ += other.sum_;
+        min_ = other.min_ < min_ ? other.min_ : min_;
+        max_ = other.max_ > max_ ? other.max_ : max_;
+    }
+
+    uint64_t count() const { return count_; }
+    uint64_t min() const { return count_ ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ ? static_cast<double>(sum_) / static_cast<double>(count_) : 0.0; }
+    int significant_digits() const { return significant_digits_; }
+    size_t memory_bytes() const { return counts_.size() * sizeof(uint64_t); }
+
+    // Smallest bucket upper bound with at least percentile% of the values at
+    // or below it, kept within the recorded minimum and maximum.
+    uint64_t value_at_percentile(double percentile) const {
+        if (count_ == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(std::ceil(percentile / 100.0 * static_cast<double>(count_)));
+        rank = rank == 0 ? 1 : rank;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                uint64_t upper = log_linear::bucket_upper_bound(i, bits_);
+                upper = upper < max_ ? upper : max_;
+                return upper > min_ ? upper : min_;
+            }
+        }
+        return max_;
+    }
+
+private:
+    int significant_digits_;
+    unsigned bits_;
+    std::vector<uint64_t> counts_;
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t min_ = UINT64_MAX;
+    uint64_t max_ = 0;
+};
+
+#endif // LATENCY_HISTOGRAM_HPP
@@ -0,0 +1,164 @@
+// listener_handoff.hpp
+#ifndef LISTENER_HANDOFF_HPP
+#define LISTENER_HANDOFF_HPP
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <vector>
+
+// -------------------------
+// Listener Handoff
+// -------------------------
+// Zero-downtime upgrade: the running server starts a fresh copy of its
+// binary and passes it the listening sockets over a Unix socket
+// (SCM_RIGHTS). Both processes then hold the same sockets, so connections
+// keep being accepted while the old process drains. The new process says so
+// on the same channel once it is accepting, and only then does the old one
+// stop.
+namespace handoff {
+
+// The channel's descriptor number in the new process.
+inline constexpr int kChannelFd = 3;
+
+inline std::system_error errno_error(const char *what) {
+    return std::system_error(errno, std::generic_category(), what);
+}
+
+// Send fds in one message; the receiver gets its own descriptors for the
+// same open sockets.
+inline void send_fds(int channel, const std::vector<int> &fds) {
+    uint32_t count = static_cast<uint32_t>(fds.size());
+    iovec iov{&count, sizeof(count)};
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * fds.size()));
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (!fds.empty()) {
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+    }
+    if (sendmsg(channel, &msg, MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(count))) {
+        throw errno_error("sendmsg(SCM_RIGHTS)");
+    }
+}
+
+inline std::vector<int> receive_fds(int channel) {
+    constexpr size_t kMaxFds = 253;  // SCM_MAX_FD
+    uint32_t count = 0;
+    iovec iov{&count, sizeof(count)};
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * kMaxFds));
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+    if (recvmsg(channel, &msg, MSG_CMSG_CLOEXEC) != static_cast<ssize_t>(sizeof(count))) {
+        throw errno_error("recvmsg(SCM_RIGHTS)");
+    }
+    std::vector<int> fds;
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            size_t received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            fds.resize(received);
+            std::memcpy(fds.data(), CMSG_DATA(cmsg), sizeof(int) * received);
+        }
+    }
+    if (fds.size() != count || (msg.msg_flags & MSG_CTRUNC)) {
+        throw std::runtime_error("listener handoff: expected " + std::to_string(count) + " descriptors, got " +
+                                 std::to_string(fds.size()));
+    }
+    return fds;
+}
+
+// Close every descriptor from first up. Runs between fork() and exec(), so
+// only async-signal-safe calls.
+inline void close_from(int first) {
+#ifdef SYS_close_range
+    if (syscall(SYS_close_range, first, ~0U, 0) == 0) {
+        return;
+    }
+#endif
+    long max_fd = sysconf(_SC_OPEN_MAX);
+    for (long fd = first; fd < max_fd; ++fd) {
+        close(static_cast<int>(fd));
+    }
+}
+
+// Start this binary again with args plus "--upgrade-fd 3" and hand it fds.
+// Nothing but stdio and the channel is inherited, so the new process holds
+// none of this one's connections. Returns the new pid once it reports that
+// it is accepting, or -1 if it exits or stays silent for timeout.
+inline pid_t start_successor(const std::vector<std::string> &args, const std::vector<int> &fds,
+                             std::chrono::milliseconds timeout) {
+    int channel[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, channel) < 0) {
+        throw errno_error("socketpair");
+    }
+    // Built before fork(): the child may only make async-signal-safe calls.
+    std::vector<std::string> child_args = args;
+    child_args.push_back("--upgrade-fd");
+    child_args.push_back(std::to_string(kChannelFd));
+    std::vector<char *> argv;
+    for (auto &arg : child_args) {
+        argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(channel[0]);
+        close(channel[1]);
+        throw errno_error("fork");
+    }
+    if (pid == 0) {
+        dup2(channel[1], kChannelFd);  // dup2 clears FD_CLOEXEC on the copy
+        close_from(kChannelFd + 1);
+        execv("/proc/self/exe", argv.data());
+        _exit(127);
+    }
+    close(channel[1]);
+
+    bool ready = false;
+    try {
+        send_fds(channel[0], fds);
+        pollfd reply{channel[0], POLLIN, 0};
+        char byte = 0;
+        ready = poll(&reply, 1, static_cast<int>(timeout.count())) == 1 && read(channel[0], &byte, 1) == 1;
+    } catch (const std::system_error &) {
+    }
+    close(channel[0]);
+    if (!ready) {
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        return -1;
+    }
+    return pid;
+}
+
+// In the new process: every listener is being accepted on, so the old
+// process can stop.
+inline void announce_ready(int channel) {
+    char byte = 1;
+    ssize_t ignored = write(channel, &byte, 1);
+    (void)ignored;
+    close(channel);
+}
+
+} // namespace handoff
+
+#endif // LISTENER_HANDOFF_HPP
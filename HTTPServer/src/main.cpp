@@ -1,3 +1,4 @@
+#include <utility>  // before Boost: 1.74's awaitable.hpp uses std::exchange without including it
 #include <boost/asio.hpp>
 #include <nlohmann/json.hpp>
 #include <iostream>
@@ -10,33 +11,145 @@
 #include <sstream>
 #include <numeric>
 #include <queue>
+#include <deque>
+#include <list>
 #include <condition_variable>
+#include <cstring>
+#include <string_view>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include "http_parser.hpp"
+#include "http_response.hpp"
+#include "router.hpp"
+#include "io_uring.hpp"
+#include "latency_histogram.hpp"
+#include "cpu_affinity.hpp"
+#include "arena.hpp"
+#include "handler_memory.hpp"
+#include "buffer_pool.hpp"
+#include "huge_pages.hpp"
+#include "timing_wheel.hpp"
+#include "admission.hpp"
+#include "listener_handoff.hpp"
+#include "socket_options.hpp"
+#include "http_response_framer.hpp"
+#include "stats_shard.hpp"
 
+using boost::asio::awaitable;
 using boost::asio::ip::tcp;
 using json = nlohmann::json;
 using namespace std;
 using namespace std::chrono;
 
+// -------------------------
+// Allocation Counting
+// -------------------------
+// Every global operator new bumps the calling I/O thread's counter, so
+// /api/stats can show allocations per request. Other threads (main,
+// benchmark jobs and the io_uring workers' coroutine threads) have no
+// counter and are not counted.
+thread_local atomic<size_t> *t_allocation_counter = nullptr;
+
+void *operator new(size_t size) {
+    if (atomic<size_t> *counter = t_allocation_counter) {
+        counter->store(counter->load(memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+    if (void *p = malloc(size ? size : 1)) {
+        return p;
+    }
+    throw bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
 // -------------------------
 // Structure for Benchmark Stats
 // -------------------------
+// Counters are sharded, one shard per worker thread, and only added up for
+// the results. Latencies go into histograms in nanoseconds: each worker
+// thread records into its own and merges it here once, at the end, so
+// recording takes no lock and memory stays the same however long the run.
 struct Stats {
-    atomic<size_t> total_requests{0};
-    atomic<size_t> failed_requests{0};
-    vector<double> latencies;  // in milliseconds
-    mutex m;
+    Stats(size_t threads, int significant_digits)
+        : counters(threads), latencies(significant_digits), uncorrected_latencies(significant_digits) {}
+
+    ShardedStats counters;
+    HdrHistogram latencies;
+    // Open loop only: latencies from the actual send rather than the
+    // scheduled one, as a closed-loop tool would report them.
+    HdrHistogram uncorrected_latencies;
+    mutex m;  // guards the histograms while workers merge into them
+};
+
+// -------------------------
+// Open-Loop Send Schedule
+// -------------------------
+// A closed loop sends the next request when the previous response is in,
+// so a stalled target also stalls the load and the stall shows up in one
+// sample instead of in every request that should have been sent meanwhile
+// (coordinated omission). In the open loop each connection has a timeline
+// fixed in advance: its k-th request is due at
+//   start + connection * spacing + k * interval,
+// where spacing is 1 / rate and interval is connections / rate, so the
+// sends of all connections interleave evenly at the target rate. A request
+// goes out when it is due, or at once if the connection is still busy with
+// an earlier one, and its latency is measured from when it was due.
+struct SendSchedule {
+    steady_clock::time_point start;
+    nanoseconds spacing{0};
+    nanoseconds interval{0};  // zero for the closed loop
+
+    SendSchedule() = default;
+    SendSchedule(steady_clock::time_point start, double rate, size_t connections)
+        : start(start), spacing(static_cast<int64_t>(1e9 / rate)),
+          interval(static_cast<int64_t>(1e9 * static_cast<double>(connections) / rate)) {}
+
+    bool open_loop() const { return interval.count() > 0; }
+
+    steady_clock::time_point due(size_t connection, size_t k) const {
+        return start + spacing * static_cast<int64_t>(connection) + interval * static_cast<int64_t>(k);
+    }
 };
 
+// How the load generator uses connections: a new one for every request, as
+// a client without connection reuse would, or one persistent connection
+// per worker thread.
+enum class ConnectionMode { per_request, keep_alive };
+
+const char *connection_mode_name(ConnectionMode mode) {
+    return mode == ConnectionMode::keep_alive ? "keep_alive" : "per_request";
+}
+
+ConnectionMode parse_connection_mode(const string &text) {
+    if (text == "per_request") {
+        return ConnectionMode::per_request;
+    }
+    if (text == "keep_alive") {
+        return ConnectionMode::keep_alive;
+    }
+    throw invalid_argument("unknown connection_mode: " + text);
+}
+
 // -------------------------
 // Target Connection Pool Class
 // -------------------------
+// Persistent connections to the target for keep-alive runs, opened before
+// the clock starts. A socket that could not be connected is still handed
+// out, closed, and its worker connects it on first use.
 class TargetConnectionPool {
 public:
     TargetConnectionPool(boost::asio::io_context &io_context,
-                         const string &host,
-                         unsigned short port,
+                         const tcp::resolver::results_type &endpoints,
                          size_t pool_size)
-        : io_context_(io_context), host_(host), port_(port), pool_size_(pool_size) {
+        : io_context_(io_context), endpoints_(endpoints), pool_size_(pool_size) {
         initialize_pool();
     }
 
@@ -66,21 +179,17 @@ private:
     void initialize_pool() {
         for (size_t i = 0; i < pool_size_; ++i) {
             auto sock = make_shared<tcp::socket>(io_context_);
-            tcp::resolver resolver(io_context_);
-            auto endpoints = resolver.resolve(host_, to_string(port_));
             boost::system::error_code ec;
-            boost::asio::connect(*sock, endpoints, ec);
+            boost::asio::connect(*sock, endpoints_, ec);
             if (ec) {
                 cerr << "Error creating pooled connection: " << ec.message() << endl;
-                continue;
             }
             sockets_.push(sock);
         }
     }
 
     boost::asio::io_context &io_context_;
-    string host_;
-    unsigned short port_;
+    tcp::resolver::results_type endpoints_;
     size_t pool_size_;
     queue<shared_ptr<tcp::socket>> sockets_;
     mutex mtx_;
@@ -88,255 +197,3517 @@ private:
 };
 
 // -------------------------
-// Modified doHttpRequestUsingSocket
-// -------------------------
-// This function uses an already connected socket to perform a GET request to the target.
-// It writes a GET request, reads the response, and returns the measured latency.
-double doHttpRequestUsingSocket(tcp::socket &socket, const string &host) {
-    auto start = steady_clock::now();
-    string req = "GET / HTTP/1.1\r\n"
-                 "Host: " + host + "\r\n"
-                 "Connection: keep-alive\r\n"
-                 "\r\n";
-    boost::asio::write(socket, boost::asio::buffer(req));
-    
-    boost::asio::streambuf response;
-    boost::asio::read_until(socket, response, "\r\n\r\n");
+// Request/Response Exchange
+// -------------------------
+enum class ExchangeResult {
+    complete,
+    closed_early,  // the connection was closed before any of the response came back
+    failed
+};
+
+// Write request on socket and read one response into buffer, framed by
+// Content-Length or chunked encoding, or by the server closing if it sends
+// neither. A body larger than the buffer is read through it. reusable says
+// whether the server keeps the connection open afterwards. Bytes written and
+// read are counted in shard.
+ExchangeResult exchange(tcp::socket &socket, boost::asio::const_buffer request, char *buffer, size_t capacity,
+                        HttpResponseFramer &framer, bool &reusable, StatsShard &shard) {
     boost::system::error_code ec;
-    while (boost::asio::read(socket, response, boost::asio::transfer_at_least(1), ec)) { }
-    
-    auto end = steady_clock::now();
-    return duration_cast<microseconds>(end - start).count() / 1000.0;
+    boost::asio::write(socket, request, ec);
+    if (ec) {
+        return ExchangeResult::closed_early;
+    }
+    StatsShard::bump(shard.bytes_sent, request.size());
+    framer.reset();
+    size_t filled = 0;
+    size_t received = 0;
+    for (;;) {
+        size_t n = socket.read_some(boost::asio::buffer(buffer + filled, capacity - filled), ec);
+        if (ec) {
+            if (ec == boost::asio::error::eof && framer.until_eof()) {
+                reusable = false;
+                return ExchangeResult::complete;
+            }
+            return received == 0 ? ExchangeResult::closed_early : ExchangeResult::failed;
+        }
+        received += n;
+        filled += n;
+        StatsShard::bump(shard.bytes_received, n);
+        size_t used = framer.feed(buffer, filled);
+        if (framer.complete()) {
+            reusable = framer.keep_alive();
+            return ExchangeResult::complete;
+        }
+        if (framer.error()) {
+            return ExchangeResult::failed;
+        }
+        memmove(buffer, buffer + used, filled - used);
+        filled -= used;
+        if (filled == capacity) {
+            return ExchangeResult::failed;  // a head or chunk line larger than the buffer
+        }
+    }
+}
+
+// The request every load generator sends.
+string benchmark_request(const string &target_host, ConnectionMode mode) {
+    return "GET / HTTP/1.1\r\n"
+           "Host: " + target_host + "\r\n"
+           "Connection: " + (mode == ConnectionMode::keep_alive ? "keep-alive" : "close") + "\r\n"
+           "\r\n";
 }
 
 // -------------------------
 // Modified benchmarkWorker using connection pool
 // -------------------------
-void benchmarkWorker(const string &target_host, unsigned short target_port,
-                     size_t requests_per_thread, Stats &stats, TargetConnectionPool &targetPool) {
+// Latencies are recorded into histograms owned by the worker thread, allocated
+// after it has been pinned so they sit on the local NUMA node, and merged into
+// stats once at the end. The request is written once into the front of the
+// worker's buffer slot and every response is read into the rest of it.
+//
+// per_request opens a connection for each request and sends Connection:
+// close; the clock starts once it is connected, or in the open loop when
+// the request is due (the uncorrected latency still starts after connect).
+// keep_alive takes one connection from the pool for the whole run. If a
+// request on a connection that has already carried a response finds it
+// closed before any of the new response came back, as when the server has
+// timed it out, it is reconnected and the request sent again once, and the
+// latency includes the reconnect. The first request on a connection is
+// not retried, as AsyncLoadWorker does not retry it: a close there is the
+// server failing. Any failure counts, and the next request starts on a
+// new connection.
+void benchmarkWorker(const string &target_host, const tcp::resolver::results_type &endpoints,
+                     ConnectionMode mode, size_t requests_per_thread, Stats &stats,
+                     TargetConnectionPool *targetPool, char *slot, size_t slot_size,
+                     const SendSchedule &schedule, size_t thread_index) {
+    StatsShard &shard = stats.counters.shard(thread_index);
+    HdrHistogram latencies(stats.latencies.significant_digits());
+    HdrHistogram uncorrected(stats.latencies.significant_digits());
+    bool keep_alive = mode == ConnectionMode::keep_alive;
+    string request_text = benchmark_request(target_host, mode);
+    if (request_text.size() >= slot_size) {
+        throw invalid_argument("target_host is too long");
+    }
+    memcpy(slot, request_text.data(), request_text.size());
+    auto request = boost::asio::buffer(slot, request_text.size());
+    char *response = slot + request_text.size();
+    size_t response_capacity = slot_size - request_text.size();
+
+    boost::asio::io_context io_ctx;
+    shared_ptr<tcp::socket> sock = keep_alive ? targetPool->acquire() : make_shared<tcp::socket>(io_ctx);
+    HttpResponseFramer framer;
+    bool reused = false;  // sock has already carried a complete exchange
     for (size_t i = 0; i < requests_per_thread; ++i) {
+        steady_clock::time_point due;
+        if (schedule.open_loop()) {
+            due = schedule.due(thread_index, i);
+            this_thread::sleep_until(due);
+        }
+        // Only connecting throws; a failed exchange is reported by its result.
         try {
-            // Acquire a socket from the pool
-            auto sock = targetPool.acquire();
-
-            // Create a new io_context and socket for each request
-            boost::asio::io_context io_ctx;
-            tcp::resolver resolver(io_ctx);
-            auto endpoints = resolver.resolve(target_host, to_string(target_port));
-            tcp::socket socket(io_ctx);
-            boost::asio::connect(socket, endpoints);
+            if (!keep_alive) {
+                boost::system::error_code ignored;
+                sock->close(ignored);
+                boost::asio::connect(*sock, endpoints);
+            } else if (!sock->is_open()) {
+                reused = false;
+                boost::asio::connect(*sock, endpoints);
+                StatsShard::bump(shard.reconnects);
+            }
 
             auto req_start = steady_clock::now();
-
-            // Build and send a GET request.
-            string req = "GET / HTTP/1.1\r\n"
-                         "Host: " + target_host + "\r\n"
-                         "Connection: close\r\n"
-                         "\r\n";
-            boost::asio::write(socket, boost::asio::buffer(req));
-
-            // Read headers.
-            boost::asio::streambuf response;
-            boost::asio::read_until(socket, response, "\r\n\r\n");
-            boost::system::error_code ec;
-            while (boost::asio::read(socket, response, boost::asio::transfer_at_least(1), ec)) { }
+            bool reusable = false;
+            ExchangeResult result = exchange(*sock, request, response, response_capacity, framer, reusable, shard);
+            if (result == ExchangeResult::closed_early && keep_alive && reused) {
+                reused = false;
+                boost::asio::connect(*sock, endpoints);
+                StatsShard::bump(shard.reconnects);
+                result = exchange(*sock, request, response, response_capacity, framer, reusable, shard);
+            }
+            if (result != ExchangeResult::complete) {
+                boost::system::error_code ignored;
+                sock->close(ignored);
+                bool closed = result == ExchangeResult::closed_early;
+                shard.count_error(closed ? LoadError::closed : LoadError::bad_response);
+                cerr << "[Worker] Request " << i << " failed: "
+                     << (closed ? "connection closed by target" : "malformed or truncated response") << endl;
+                continue;
+            }
             auto req_end = steady_clock::now();
-            double latency = duration_cast<microseconds>(req_end - req_start).count() / 1000.0;
-
-            {
-                lock_guard<mutex> lock(stats.m);
-                stats.latencies.push_back(latency);
+            if (schedule.open_loop()) {
+                uncorrected.record(duration_cast<nanoseconds>(req_end - req_start).count());
+                latencies.record(duration_cast<nanoseconds>(req_end - due).count());
+            } else {
+                latencies.record(duration_cast<nanoseconds>(req_end - req_start).count());
+            }
+            shard.count_response(framer.status_code());
+            reused = reusable;
+            if (!reusable) {
+                boost::system::error_code ignored;
+                sock->close(ignored);
             }
-            stats.total_requests++;
-            // Release the socket back to the pool
-            targetPool.release(sock);
         } catch (std::exception &e) {
-            stats.failed_requests++;
+            reused = false;
+            shard.count_error(LoadError::connect);
             cerr << "[Worker] Request " << i << " failed: " << e.what() << endl;
         }
     }
+    if (keep_alive) {
+        targetPool->release(sock);
+    }
+    lock_guard<mutex> lock(stats.m);
+    stats.latencies.merge(latencies);
+    stats.uncorrected_latencies.merge(uncorrected);
 }
 
 // -------------------------
-// HTTPServer Class (Benchmark Handler)
+// AsyncLoadWorker Class
 // -------------------------
-class HTTPServer {
+// The event-driven load generator: one per thread, running its own
+// io_context and driving any number of connections, each a state machine
+// that connects, writes the request, reads until the response is framed,
+// records the latency and starts over. Concurrency is the number of
+// connections, not threads. A connection is a socket, a response framer,
+// recycled handler memory and a receive buffer carved from the thread's
+// mapping, a few kilobytes in all. Requests are drawn from the thread's
+// budget until it is spent; a failed connect or request uses up its
+// request too, so an unreachable target cannot keep the run going.
+// Connection modes and reconnects work as in benchmarkWorker. In the open
+// loop a connection waits on its timer until its next request is due; a
+// keep-alive connection connects before waiting, a per_request one after.
+// Counters go to the thread's own shard of stats; latencies are recorded
+// locally and merged into stats once at the end.
+class AsyncLoadWorker {
 public:
-    HTTPServer(boost::asio::io_context &io_context, unsigned short port)
-        : acceptor_(io_context, tcp::endpoint(tcp::v4(), port)) {
-        cout << "Server listening on port " << port << endl;
-        start_accept();
+    static constexpr size_t kReceiveBufferSize = 2048;
+
+    struct Connection {
+        Connection(boost::asio::io_context &io_context, char *buffer, size_t index)
+            : socket(io_context), timer(io_context), buffer(buffer), index(index) {}
+
+        tcp::socket socket;
+        boost::asio::steady_timer timer;  // open loop: waits for the next due time
+        HttpResponseFramer framer;
+        HandlerMemory<256> memory;
+        char *buffer;
+        size_t index;              // position in the schedule, across all threads
+        size_t scheduled = 0;      // requests this connection has been given
+        size_t filled = 0;
+        size_t received = 0;
+        steady_clock::time_point due;
+        steady_clock::time_point sent;
+        bool connected_before = false;
+        bool reused = false;   // has had a response on the current socket
+        bool retried = false;  // the current request is being sent again
+    };
+
+    // Bytes each connection takes in this process, besides kernel buffers.
+    static constexpr size_t kConnectionBytes = sizeof(Connection) + kReceiveBufferSize;
+
+    // buffers holds kReceiveBufferSize bytes per connection. This thread's
+    // connections are first_connection onwards in the schedule.
+    AsyncLoadWorker(const tcp::endpoint &target, ConnectionMode mode, string request, size_t requests,
+                    size_t connections, char *buffers, const SendSchedule &schedule, size_t first_connection,
+                    StatsShard &shard, int significant_digits)
+        : target_(target), mode_(mode), request_(std::move(request)), requests_(requests), schedule_(schedule),
+          shard_(shard), latencies_(significant_digits), uncorrected_(significant_digits) {
+        for (size_t i = 0; i < connections; ++i) {
+            connections_.emplace_back(io_context_, buffers + i * kReceiveBufferSize, first_connection + i);
+        }
+    }
+
+    // Runs until the budget is spent and every connection has finished.
+    void run(Stats &stats) {
+        for (auto &connection : connections_) {
+            next_request(connection);
+        }
+        io_context_.run();
+        lock_guard<mutex> lock(stats.m);
+        stats.latencies.merge(latencies_);
+        stats.uncorrected_latencies.merge(uncorrected_);
     }
+
 private:
-    void send_json_response(tcp::socket &socket, const json &data, int status_code = 200) {
-        try {
-            string json_str = data.dump();
-            string response =
-                "HTTP/1.1 " + to_string(status_code) + " OK\r\n"
-                "Content-Type: application/json; charset=utf-8\r\n"
-                "Access-Control-Allow-Origin: *\r\n"
-                "Access-Control-Allow-Methods: POST, OPTIONS\r\n"
-                "Access-Control-Allow-Headers: Content-Type\r\n"
-                "Content-Length: " + to_string(json_str.size()) + "\r\n"
-                "Connection: close\r\n"
-                "\r\n" +
-                json_str;
-            boost::asio::write(socket, boost::asio::buffer(response));
-        } catch (exception &e) {
-            cerr << "Error sending JSON response: " << e.what() << endl;
+    template <typename Handler>
+    auto bind(Connection &connection, Handler handler) {
+        return make_custom_alloc_handler(connection.memory, std::move(handler));
+    }
+
+    void next_request(Connection &connection) {
+        if (issued_ == requests_) {
+            close(connection);
+            return;
+        }
+        ++issued_;
+        connection.retried = false;
+        if (schedule_.open_loop()) {
+            connection.due = schedule_.due(connection.index, connection.scheduled++);
+        }
+        if (mode_ == ConnectionMode::keep_alive && !connection.socket.is_open()) {
+            connect(connection);
+        } else {
+            when_due(connection);
         }
     }
 
-    void handle_connection(tcp::socket socket) {
-        try {
-            boost::asio::streambuf buffer;
-            boost::system::error_code ec;
-            boost::asio::read_until(socket, buffer, "\r\n\r\n", ec);
+    void when_due(Connection &connection) {
+        if (connection.due <= steady_clock::now()) {
+            send(connection);
+            return;
+        }
+        connection.timer.expires_at(connection.due);
+        connection.timer.async_wait(bind(connection, [this, &connection](boost::system::error_code) {
+            send(connection);
+        }));
+    }
+
+    void send(Connection &connection) {
+        if (connection.socket.is_open()) {
+            write(connection);
+        } else {
+            connect(connection);
+        }
+    }
+
+    void connect(Connection &connection) {
+        if (mode_ == ConnectionMode::keep_alive && connection.connected_before) {
+            StatsShard::bump(shard_.reconnects);
+        }
+        connection.reused = false;
+        connection.socket.async_connect(target_, bind(connection, [this, &connection](boost::system::error_code ec) {
             if (ec) {
-                if (ec == boost::asio::error::eof) return;
-                cerr << "Error reading headers: " << ec.message() << endl;
+                fail(connection, LoadError::connect, ec.message());
                 return;
             }
-            
-            istream request_stream(&buffer);
-            string request_line;
-            getline(request_stream, request_line);
-            
-            // Parse headers for Content-Length.
-            string header;
-            size_t content_length = 0;
-            while (getline(request_stream, header) && header != "\r") {
-                if (header.find("Content-Length: ") == 0) {
-                    content_length = stoul(header.substr(16));
-                }
-            }
-            
-            // Read the body if present.
-            string body;
-            if (content_length > 0) {
-                body.resize(content_length);
-                request_stream.read(&body[0], content_length);
-            }
-            
-            istringstream request_line_stream(request_line);
-            string method, path, version;
-            request_line_stream >> method >> path >> version;
-            
-            // Handle OPTIONS for CORS.
-            if (method == "OPTIONS") {
-                string response =
-                    "HTTP/1.1 200 OK\r\n"
-                    "Access-Control-Allow-Origin: *\r\n"
-                    "Access-Control-Allow-Methods: POST, OPTIONS\r\n"
-                    "Access-Control-Allow-Headers: Content-Type\r\n"
-                    "Content-Length: 0\r\n"
-                    "Connection: close\r\n"
-                    "\r\n";
-                boost::asio::write(socket, boost::asio::buffer(response));
-                return;
+            connection.connected_before = true;
+            boost::system::error_code ignored;
+            connection.socket.set_option(tcp::no_delay(true), ignored);
+            if (mode_ == ConnectionMode::keep_alive && !connection.retried) {
+                when_due(connection);
+            } else {
+                write(connection);
             }
-            
-            // Handle POST /api/benchmark.
-            if (method == "POST" && path == "/api/benchmark") {
-                json request_data = json::parse(body);
-                int num_threads = request_data["num_threads"];
-                int requests_per_thread = request_data["requests_per_thread"];
-                string target_host = request_data.value("target_host", "127.0.0.1");
-                int target_port = request_data.value("target_port", 8080);
-                
-                // IMPORTANT: If your target server is the same as this benchmark server,
-                // consider using a different port so they don't conflict.
-                
-                // Create a shared io_context for target requests.
-                boost::asio::io_context bench_io_context;
-                // Create a connection pool. For example, allocate 2 connections per benchmark thread.
-                size_t pool_size = num_threads*num_threads ;
-                TargetConnectionPool targetPool(bench_io_context, target_host, target_port, pool_size);
-                
-                Stats stats;
-                vector<thread> threads;
-                auto start_time = steady_clock::now();
-                for (int i = 0; i < num_threads; ++i) {
-                    threads.emplace_back([&]() {
-                    benchmarkWorker(target_host, target_port, requests_per_thread, stats, targetPool);
-                });
+        }));
+    }
+
+    // The clock starts at the first write of a request, as in
+    // benchmarkWorker: after the connect in per_request mode, before the
+    // reconnect when a keep-alive request is sent again. In the open loop
+    // the latency recorded first runs from the due time instead.
+    void write(Connection &connection) {
+        if (!connection.retried) {
+            connection.sent = steady_clock::now();
+        }
+        boost::asio::async_write(connection.socket, boost::asio::buffer(request_),
+            bind(connection, [this, &connection](boost::system::error_code ec, size_t) {
+                if (ec) {
+                    closed_early(connection, ec);
+                    return;
+                }
+                StatsShard::bump(shard_.bytes_sent, request_.size());
+                connection.framer.reset();
+                connection.filled = 0;
+                connection.received = 0;
+                read(connection);
+            }));
+    }
 
+    void read(Connection &connection) {
+        connection.socket.async_read_some(
+            boost::asio::buffer(connection.buffer + connection.filled, kReceiveBufferSize - connection.filled),
+            bind(connection, [this, &connection](boost::system::error_code ec, size_t n) {
+                if (ec) {
+                    if (ec == boost::asio::error::eof && connection.framer.until_eof()) {
+                        complete(connection, false);
+                    } else if (connection.received == 0) {
+                        closed_early(connection, ec);
+                    } else {
+                        fail(connection, LoadError::bad_response, ec.message());
+                    }
+                    return;
                 }
-                for (auto &t : threads) {
-                    t.join();
+                StatsShard::bump(shard_.bytes_received, n);
+                connection.received += n;
+                connection.filled += n;
+                size_t used = connection.framer.feed(connection.buffer, connection.filled);
+                if (connection.framer.complete()) {
+                    complete(connection, connection.framer.keep_alive());
+                    return;
                 }
-                auto end_time = steady_clock::now();
-                double duration = duration_cast<milliseconds>(end_time - start_time).count() / 1000.0;
-                
-                size_t total = stats.total_requests.load();
-                size_t failed = stats.failed_requests.load();
-                double throughput = (duration > 0) ? (total / duration) : 0.0;
-                
-                vector<double> latencies;
-                {
-                    lock_guard<mutex> lock(stats.m);
-                    latencies = stats.latencies;
+                if (connection.framer.error() || connection.filled - used == kReceiveBufferSize) {
+                    fail(connection, LoadError::bad_response, "malformed or oversized response");
+                    return;
                 }
-                sort(latencies.begin(), latencies.end());
-                double avg_latency = latencies.empty() ? 0 : accumulate(latencies.begin(), latencies.end(), 0.0) / latencies.size();
-                
-                size_t p50_index = static_cast<size_t>(latencies.size() * 0.50);
-                size_t p95_index = static_cast<size_t>(latencies.size() * 0.95);
-                size_t p99_index = static_cast<size_t>(latencies.size() * 0.99);
-                double p50 = latencies.empty() ? 0 : latencies[min(p50_index, latencies.size()-1)];
-                double p95 = latencies.empty() ? 0 : latencies[min(p95_index, latencies.size()-1)];
-                double p99 = latencies.empty() ? 0 : latencies[min(p99_index, latencies.size()-1)];
-                
-                json result;
-                result["total_requests"]   = total;
-                result["failed_requests"]  = failed;
-                result["throughput"]       = throughput;
-                result["avg_latency"]      = avg_latency;
-                result["p50_latency"]      = p50;
-                result["p95_latency"]      = p95;
-                result["p99_latency"]      = p99;
-                result["duration"]         = duration;
-                
-                send_json_response(socket, result, 200);
-                boost::system::error_code ec2;
-                // socket.shutdown(tcp::socket::shutdown_both, ec2);
-                // socket.close();
-                return;
+                memmove(connection.buffer, connection.buffer + used, connection.filled - used);
+                connection.filled -= used;
+                read(connection);
+            }));
+    }
+
+    void complete(Connection &connection, bool reusable) {
+        auto now = steady_clock::now();
+        if (schedule_.open_loop()) {
+            uncorrected_.record(duration_cast<nanoseconds>(now - connection.sent).count());
+            latencies_.record(duration_cast<nanoseconds>(now - connection.due).count());
+        } else {
+            latencies_.record(duration_cast<nanoseconds>(now - connection.sent).count());
+        }
+        shard_.count_response(connection.framer.status_code());
+        if (mode_ == ConnectionMode::per_request || !reusable) {
+            close(connection);
+        } else {
+            connection.reused = true;
+        }
+        next_request(connection);
+    }
+
+    // Nothing of the response arrived: a reused keep-alive connection was
+    // closed by the target, so the request goes out once more on a new one.
+    void closed_early(Connection &connection, boost::system::error_code ec) {
+        if (mode_ == ConnectionMode::keep_alive && connection.reused && !connection.retried) {
+            connection.retried = true;
+            close(connection);
+            connect(connection);
+            return;
+        }
+        fail(connection, LoadError::closed, ec.message());
+    }
+
+    void fail(Connection &connection, LoadError kind, const string &error) {
+        shard_.count_error(kind);
+        if (failed_++ == 0) {
+            cerr << "[Worker] Request failed: " << error << " (further failures on this thread only counted)"
+                 << endl;
+        }
+        close(connection);
+        next_request(connection);
+    }
+
+    void close(Connection &connection) {
+        boost::system::error_code ignored;
+        connection.socket.close(ignored);
+    }
+
+    boost::asio::io_context io_context_{1};
+    const tcp::endpoint target_;
+    const ConnectionMode mode_;
+    const string request_;
+    const size_t requests_;
+    const SendSchedule schedule_;
+    size_t issued_ = 0;
+    StatsShard &shard_;
+    size_t failed_ = 0;  // only to log the first failure
+    deque<Connection> connections_;
+    HdrHistogram latencies_;
+    HdrHistogram uncorrected_;
+};
+
+// Each connection needs a descriptor; raise the soft limit as far as the
+// hard limit allows.
+void raise_file_limit(size_t needed) {
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < needed + 64) {
+        limit.rlim_cur = min<rlim_t>(limit.rlim_max, needed + 64);
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// -------------------------
+// Topology Reporting
+// -------------------------
+json cpu_list_json(const vector<int> &cpus) {
+    return cpus.empty() ? json("unpinned") : json(cpu_affinity::format_cpu_list(cpus));
+}
+
+json topology_json() {
+    const auto &topology = cpu_affinity::topology();
+    json nodes = json::array();
+    for (const auto &node : topology.nodes) {
+        nodes.push_back({{"node", node.id}, {"cpus", cpu_affinity::format_cpu_list(node.cpus)}});
+    }
+    json result;
+    result["online_cpus"] = cpu_affinity::format_cpu_list(topology.online_cpus);
+    result["numa_nodes"] = nodes;
+    return result;
+}
+
+
+// Mean, percentiles and maximum of a latency histogram in milliseconds.
+json latency_summary(const HdrHistogram &latencies) {
+    auto ms = [](uint64_t ns) { return ns / 1e6; };
+    json summary;
+    summary["avg"]   = latencies.mean() / 1e6;
+    summary["p50"]   = ms(latencies.value_at_percentile(50));
+    summary["p95"]   = ms(latencies.value_at_percentile(95));
+    summary["p99"]   = ms(latencies.value_at_percentile(99));
+    summary["p999"]  = ms(latencies.value_at_percentile(99.9));
+    summary["p9999"] = ms(latencies.value_at_percentile(99.99));
+    summary["max"]   = ms(latencies.max());
+    return summary;
+}
+
+// -------------------------
+// Benchmark Job
+// -------------------------
+// Runs a full benchmark described by the POST /api/benchmark body and returns
+// the results JSON. This blocks for the whole run, so callers must keep it off
+// the server's I/O threads. Worker i is pinned to cpus[i % cpus.size()], where
+// cpus is the request's "cpus" list if it has one and default_cpus otherwise.
+// Each worker maps its own request/response buffer slot after pinning, on
+// huge pages per the request's "huge_pages" field or default_huge_pages.
+json run_benchmark(const json &request_data, const vector<int> &default_cpus,
+                   huge_pages::Mode default_huge_pages) {
+    static constexpr size_t kBufferSlotSize = 16384;
+
+    // at() throws for a missing field; const operator[] would not.
+    int num_threads = request_data.at("num_threads").get<int>();
+    int requests_per_thread = request_data.at("requests_per_thread").get<int>();
+    if (num_threads <= 0) {
+        throw invalid_argument("num_threads must be positive");
+    }
+    if (requests_per_thread < 0) {
+        throw invalid_argument("requests_per_thread must not be negative");
+    }
+    string target_host = request_data.value("target_host", "127.0.0.1");
+    int target_port = request_data.value("target_port", 8080);
+    vector<int> cpus = default_cpus;
+    if (request_data.contains("cpus")) {
+        cpus = cpu_affinity::parse_cpu_list(request_data["cpus"].get<string>());
+    }
+    huge_pages::Mode huge_page_mode = default_huge_pages;
+    if (request_data.contains("huge_pages")) {
+        huge_page_mode = huge_pages::parse_mode(request_data["huge_pages"].get<string>());
+    }
+    ConnectionMode mode = parse_connection_mode(request_data.value("connection_mode", "per_request"));
+    // With "connections", the async engine spreads that many connections
+    // over the threads; without, each thread is one blocking connection.
+    // Every thread needs at least one connection, or its budget is never
+    // sent and the load comes out lower than asked for.
+    static constexpr int64_t kMaxConnections = 1'000'000;
+    bool async = request_data.contains("connections");
+    size_t connections = static_cast<size_t>(num_threads);
+    if (async) {
+        const json &requested = request_data["connections"];
+        if (!requested.is_number_integer() || requested.get<int64_t>() < num_threads ||
+            requested.get<int64_t>() > kMaxConnections) {
+            throw invalid_argument("connections must be a whole number from num_threads to " +
+                                   to_string(kMaxConnections));
+        }
+        connections = requested.get<size_t>();
+        raise_file_limit(connections);
+    }
+    // With "rate" (requests per second across all connections) requests are
+    // sent on an open-loop schedule instead of back to back. The schedule
+    // counts whole nanoseconds, so sends must be due at least 1 ns apart.
+    double rate = 0;
+    if (request_data.contains("rate")) {
+        rate = request_data["rate"].get<double>();
+        if (!(rate > 0) || rate > 1e9) {
+            throw invalid_argument("rate must be above 0 and at most 1e9 requests per second");
+        }
+    }
+    // Latency precision: 1, 2 or 3 significant digits.
+    int significant_digits = request_data.value("latency_significant_digits", 2);
+
+    // IMPORTANT: If your target server is the same as this benchmark server,
+    // consider using a different port so they don't conflict.
+
+    // Create a shared io_context for target requests.
+    boost::asio::io_context bench_io_context;
+    tcp::resolver resolver(bench_io_context);
+    auto endpoints = resolver.resolve(target_host, to_string(target_port));
+    // One persistent connection per worker thread.
+    unique_ptr<TargetConnectionPool> targetPool;
+    if (mode == ConnectionMode::keep_alive && !async) {
+        targetPool = make_unique<TargetConnectionPool>(bench_io_context, endpoints, num_threads);
+    }
+
+    Stats stats(num_threads, significant_digits);
+    vector<thread> threads;
+    vector<int> thread_cpus(num_threads, -1);
+    vector<huge_pages::Backing> slot_backing(num_threads, huge_pages::Backing::small_pages);
+    auto start_time = steady_clock::now();
+    SendSchedule schedule;
+    if (rate > 0) {
+        // A short lead so every thread is running before the first send is due.
+        schedule = SendSchedule(start_time + milliseconds(10), rate, connections);
+    }
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back([&, i]() {
+        if (!cpus.empty()) {
+            cpu_affinity::pin_current_thread(cpus[i % cpus.size()]);
+        }
+        try {
+            if (async) {
+                size_t share = connections / num_threads + (static_cast<size_t>(i) < connections % num_threads);
+                size_t first = connections / num_threads * i + min<size_t>(i, connections % num_threads);
+                huge_pages::Mapping buffers = huge_pages::map(max<size_t>(1, share) * AsyncLoadWorker::kReceiveBufferSize,
+                                                              huge_page_mode);
+                slot_backing[i] = buffers.backing();
+                AsyncLoadWorker worker(*endpoints.begin(), mode, benchmark_request(target_host, mode),
+                                       requests_per_thread, share, buffers.data(), schedule, first,
+                                       stats.counters.shard(i), significant_digits);
+                worker.run(stats);
             } else {
-                json err;
-                err["error"] = "Not Found";
-                send_json_response(socket, err, 404);
-                boost::system::error_code ec2;
-                socket.shutdown(tcp::socket::shutdown_both, ec2);
-                socket.close();
-                return;
+                huge_pages::Mapping slot = huge_pages::map(kBufferSlotSize, huge_page_mode);
+                slot_backing[i] = slot.backing();
+                benchmarkWorker(target_host, endpoints, mode, requests_per_thread, stats, targetPool.get(),
+                                slot.data(), slot.size(), schedule, i);
             }
         } catch (exception &e) {
-            cerr << "Exception in connection handler: " << e.what() << endl;
+            // The worker did not start, or stopped part way: what it had not
+            // yet counted as done or failed is charged to setup.
+            StatsShard &shard = stats.counters.shard(i);
+            uint64_t counted = min<uint64_t>(shard.requests.load(memory_order_relaxed) +
+                                                 shard.failures.load(memory_order_relaxed),
+                                             requests_per_thread);
+            shard.count_error(LoadError::setup, requests_per_thread - counted);
+            cerr << "[Worker] " << e.what() << endl;
+        }
+        thread_cpus[i] = sched_getcpu();
+    });
+
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    auto end_time = steady_clock::now();
+    double duration = duration_cast<milliseconds>(end_time - start_time).count() / 1000.0;
+
+    ShardedStats::Totals counters = stats.counters.merge();
+    size_t total = counters.requests;
+    size_t failed = counters.failures;
+    double throughput = (duration > 0) ? (total / duration) : 0.0;
+
+    json latency;
+    json uncorrected;
+    {
+        lock_guard<mutex> lock(stats.m);
+        latency = latency_summary(stats.latencies);
+        uncorrected = latency_summary(stats.uncorrected_latencies);
+    }
+
+    json result;
+    result["total_requests"]   = total;
+    result["failed_requests"]  = failed;
+    result["throughput"]       = throughput;
+    result["avg_latency"]      = latency["avg"];
+    result["p50_latency"]      = latency["p50"];
+    result["p95_latency"]      = latency["p95"];
+    result["p99_latency"]      = latency["p99"];
+    result["p999_latency"]     = latency["p999"];
+    result["p9999_latency"]    = latency["p9999"];
+    result["max_latency"]      = latency["max"];
+    result["latency_histogram"] = {
+        {"significant_digits", significant_digits},
+        {"bytes", stats.latencies.memory_bytes()}
+    };
+    result["duration"]         = duration;
+    result["load_model"]       = schedule.open_loop() ? "open_loop" : "closed_loop";
+    if (schedule.open_loop()) {
+        // The latencies above are corrected for coordinated omission.
+        result["target_rate"]          = rate;
+        result["uncorrected_latency"]  = uncorrected;
+    }
+    result["connection_mode"]  = connection_mode_name(mode);
+    result["engine"]           = async ? "async" : "threads";
+    result["connections"]      = connections;
+    if (async) {
+        result["connection_bytes"] = AsyncLoadWorker::kConnectionBytes;
+    }
+    result["reconnects"]       = counters.reconnects;
+    result["bytes_sent"]       = counters.bytes_sent;
+    result["bytes_received"]   = counters.bytes_received;
+    json status_codes;
+    for (size_t i = 1; i < counters.status_classes.size(); ++i) {
+        status_codes[to_string(i) + "xx"] = counters.status_classes[i];
+    }
+    status_codes["other"] = counters.status_classes[0];
+    result["status_codes"] = status_codes;
+    json errors;
+    for (size_t i = 0; i < kLoadErrorKinds; ++i) {
+        errors[load_error_name(static_cast<LoadError>(i))] = counters.errors[i];
+    }
+    result["errors"] = errors;
+
+    json topology = topology_json();
+    json thread_nodes = json::array();
+    for (int cpu : thread_cpus) {
+        thread_nodes.push_back(cpu_affinity::topology().node_of(cpu));
+    }
+    topology["benchmark_cpus"]         = cpu_list_json(cpus);
+    topology["benchmark_thread_cpus"]  = thread_cpus;
+    topology["benchmark_thread_nodes"] = thread_nodes;
+    result["topology"]                 = topology;
+
+    json backing = json::array();
+    size_t fallbacks = 0;
+    for (auto slot : slot_backing) {
+        backing.push_back(huge_pages::backing_name(slot));
+        fallbacks += static_cast<int>(slot) < static_cast<int>(huge_page_mode);
+    }
+    result["buffers"] = {
+        {"huge_pages", huge_pages::mode_name(huge_page_mode)},
+        {"slot_backing", backing},
+        {"fallbacks", fallbacks}
+    };
+    return result;
+}
+
+// -------------------------
+// Server Configuration
+// -------------------------
+class PreforkSegment;
+
+struct ServerConfig {
+    unsigned short port = 8080;
+    // Number of I/O threads; each one runs its own io_context. In prefork
+    // mode, the number per process.
+    size_t num_threads = max<size_t>(1, thread::hardware_concurrency());
+    // Prefork mode: fork this many worker processes sharing SO_REUSEPORT
+    // listeners; 0 serves from this process.
+    size_t processes = 0;
+    // Give every I/O thread its own SO_REUSEPORT listener instead of sharing
+    // a single acceptor; the kernel then spreads connections across threads.
+    bool reuse_port = false;
+    // How long a keep-alive connection may sit idle between requests.
+    milliseconds keep_alive_timeout{5000};
+    // How long a client may take to send a request head once it has started
+    // it, to send the body once the head is in, and to accept a response.
+    milliseconds header_timeout{10000};
+    milliseconds body_timeout{30000};
+    milliseconds write_timeout{10000};
+    // Largest request head accepted (431 beyond it) and largest body (413).
+    size_t max_header_size = 8192;
+    size_t max_body_size = 1 << 20;
+    // Admission control; 0 turns each off. Connections over max_connections
+    // and requests over max_in_flight (admitted, not yet answered) get a 503.
+    // With a shed target, an I/O thread whose queue delay stays above it for
+    // a whole shed interval sheds new requests until it recovers.
+    size_t max_connections = 0;
+    size_t max_in_flight = 0;
+    milliseconds shed_target{0};
+    milliseconds shed_interval{100};
+    // How long SIGTERM (or a hot upgrade) waits for open connections and
+    // running benchmark jobs to finish before exiting anyway.
+    milliseconds drain_timeout{30000};
+    // Set by a hot upgrade: the channel to the previous process, and the
+    // listening sockets received over it.
+    int upgrade_fd = -1;
+    vector<int> inherited_listeners;
+    // Set in a prefork worker process: the shared stats segment and this
+    // process's slot in it.
+    PreforkSegment *prefork = nullptr;
+    size_t process_index = 0;
+    // Network backend; io_uring falls back to asio when the kernel lacks it.
+    enum class Backend { asio, io_uring };
+    Backend backend = Backend::asio;
+    // How an idle I/O thread waits: block in the kernel, spin polling for
+    // ready work, or spin for spin_before_block and then block.
+    enum class PollMode { block, spin, hybrid };
+    PollMode poll_mode = PollMode::block;
+    microseconds spin_before_block{100};
+    // SO_BUSY_POLL on accepted sockets (with SO_PREFER_BUSY_POLL); 0 is off.
+    int busy_poll_us = 0;
+    // TCP options for listeners and accepted sockets (socket_options.hpp).
+    socket_options::Options socket;
+    // Period of the timer that samples wake-up latency; 0 (the default)
+    // turns it off, so idle threads are not woken just to measure.
+    microseconds wakeup_probe_interval{0};
+    // CPUs for I/O thread i (io_cpus[i % size]) and the default set for
+    // benchmark workers; empty leaves threads unpinned.
+    vector<int> io_cpus;
+    vector<int> benchmark_cpus;
+    // Back receive buffer pools and benchmark buffers with 2 MiB pages.
+    huge_pages::Mode huge_pages = huge_pages::Mode::off;
+};
+
+const char *poll_mode_name(ServerConfig::PollMode mode) {
+    switch (mode) {
+    case ServerConfig::PollMode::block:  return "block";
+    case ServerConfig::PollMode::spin:   return "spin";
+    case ServerConfig::PollMode::hybrid: return "hybrid";
+    }
+    return "unknown";
+}
+
+// Report where I/O threads and benchmark workers will run.
+void print_placement(const ServerConfig &config) {
+    if (config.io_cpus.empty() && config.benchmark_cpus.empty()) {
+        return;
+    }
+    const auto &topology = cpu_affinity::topology();
+    auto describe = [&topology](const vector<int> &cpus) {
+        if (cpus.empty()) {
+            return string("unpinned");
+        }
+        string nodes;
+        for (const auto &node : topology.nodes) {
+            if (any_of(cpus.begin(), cpus.end(), [&](int cpu) { return topology.node_of(cpu) == node.id; })) {
+                nodes += (nodes.empty() ? "" : ",") + to_string(node.id);
+            }
+        }
+        return "CPUs " + cpu_affinity::format_cpu_list(cpus) + " (NUMA node " + nodes + ")";
+    };
+    cout << "I/O threads: " << describe(config.io_cpus)
+         << "; benchmark workers: " << describe(config.benchmark_cpus) << endl;
+}
+
+void print_huge_pages(const ServerConfig &config) {
+    if (config.huge_pages != huge_pages::Mode::off) {
+        cout << "I/O buffers on " << huge_pages::mode_name(config.huge_pages)
+             << " huge pages where available (see receive_buffers in /api/stats)" << endl;
+    }
+}
+
+void print_admission(const ServerConfig &config) {
+    if (config.max_connections == 0 && config.max_in_flight == 0 && config.shed_target.count() == 0) {
+        return;
+    }
+    auto limit = [](size_t value) { return value == 0 ? string("unlimited") : to_string(value); };
+    cout << "Admission control: " << limit(config.max_connections) << " connections, "
+         << limit(config.max_in_flight) << " requests in flight";
+    if (config.shed_target.count() > 0) {
+        cout << ", shedding when queue delay stays above " << config.shed_target.count() << " ms for "
+             << config.shed_interval.count() << " ms";
+    }
+    cout << endl;
+}
+
+// The CPU a per-thread listener asks SO_INCOMING_CPU to steer its
+// connections from: its I/O thread's, if threads are pinned; else -1.
+int listener_cpu(const ServerConfig &config, size_t thread) {
+    if (!config.socket.incoming_cpu || config.io_cpus.empty()) {
+        return -1;
+    }
+    return config.io_cpus[thread % config.io_cpus.size()];
+}
+
+// A listening socket on port that others can share with SO_REUSEPORT: the
+// io_uring workers' listeners, and the ones a prefork master hands out.
+int open_reuseport_listener(unsigned short port, const socket_options::Options &options, int cpu) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw system_error(errno, generic_category(), "socket");
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    socket_options::apply_listener(fd, options, cpu);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 ||
+        ::listen(fd, options.backlog) < 0) {
+        system_error error(errno, generic_category(), "bind/listen");
+        close(fd);
+        throw error;
+    }
+    return fd;
+}
+
+// With a hot upgrade, the listening sockets the previous process handed
+// over, one per listener; otherwise empty. The previous process runs the
+// same command line and so normally had as many listeners. If not, sockets
+// are shared round-robin or the extra ones closed.
+vector<int> take_inherited_listeners(ServerConfig &config, size_t count) {
+    vector<int> inherited = std::move(config.inherited_listeners);
+    config.inherited_listeners.clear();
+    if (inherited.empty()) {
+        return inherited;
+    }
+    vector<int> listeners;
+    for (size_t i = 0; i < count; ++i) {
+        listeners.push_back(i < inherited.size() ? inherited[i] : fcntl(inherited[i % inherited.size()],
+                                                                         F_DUPFD_CLOEXEC, 0));
+    }
+    for (size_t i = count; i < inherited.size(); ++i) {
+        close(inherited[i]);
+    }
+    return listeners;
+}
+
+// Turn on socket busy polling. Values above net.core.busy_read need
+// CAP_NET_ADMIN, so this can fail; the first failure is reported.
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+
+bool apply_busy_poll(int fd, int busy_poll_us) {
+    int prefer = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll_us, sizeof(busy_poll_us)) == 0 &&
+        setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer)) == 0) {
+        return true;
+    }
+    static atomic<bool> reported{false};
+    if (!reported.exchange(true)) {
+        cerr << "SO_BUSY_POLL/SO_PREFER_BUSY_POLL not applied: " << strerror(errno) << endl;
+    }
+    return false;
+}
+
+// -------------------------
+// Per-Worker Stats
+// -------------------------
+// Counters owned by one I/O thread. Each block sits on its own cache line so
+// workers never write to a line another worker touches; readers merge them.
+struct alignas(64) WorkerStats {
+    atomic<size_t> connections_accepted{0};
+    atomic<size_t> requests_served{0};
+    // Socket or ring syscalls issued by the I/O path. On the asio backend
+    // this counts read and write attempts and excludes epoll_wait.
+    atomic<size_t> io_syscalls{0};
+    // Heap allocations made on this thread.
+    atomic<size_t> allocations{0};
+    // How late the wake-up probe timer ran, in nanoseconds.
+    LatencyHistogram wakeup_latency;
+    // The thread's receive buffer pool.
+    BufferPool::Counters receive_buffers;
+    // Connections closed for missing a deadline, by phase.
+    atomic<size_t> idle_timeouts{0};
+    atomic<size_t> header_timeouts{0};
+    atomic<size_t> body_timeouts{0};
+    atomic<size_t> write_timeouts{0};
+    // Admission decisions. Queued requests were admitted while the thread's
+    // queue delay was above the shed target.
+    atomic<size_t> admitted_requests{0};
+    atomic<size_t> queued_requests{0};
+    atomic<size_t> shed_connections{0};
+    atomic<size_t> shed_in_flight{0};
+    atomic<size_t> shed_queue_delay{0};
+};
+
+json latency_summary_us(const LatencyHistogram &histogram) {
+    auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+    return {
+        {"count", histogram.count()},
+        {"mean", histogram.mean() / 1000.0},
+        {"p50", us(histogram.value_at_percentile(50))},
+        {"p90", us(histogram.value_at_percentile(90))},
+        {"p99", us(histogram.value_at_percentile(99))},
+        {"p99.9", us(histogram.value_at_percentile(99.9))},
+        {"max", us(histogram.max())}
+    };
+}
+
+json mapping_counters_json(const huge_pages::Counters &counters) {
+    return {
+        {"hugetlb", counters.hugetlb_mappings.load(memory_order_relaxed)},
+        {"thp", counters.thp_mappings.load(memory_order_relaxed)},
+        {"small_pages", counters.small_page_mappings.load(memory_order_relaxed)},
+        {"fallbacks", counters.fallbacks.load(memory_order_relaxed)},
+        {"mapped_bytes", counters.mapped_bytes.load(memory_order_relaxed)}
+    };
+}
+
+json buffer_pool_json(const BufferPool::Counters &counters) {
+    return {
+        {"buffers_in_use", counters.buffers_in_use.load(memory_order_relaxed)},
+        {"buffers_total", counters.buffers_total.load(memory_order_relaxed)},
+        {"bytes_in_use", counters.bytes_in_use.load(memory_order_relaxed)},
+        {"bytes_reserved", counters.bytes_reserved.load(memory_order_relaxed)},
+        {"oversized_buffers", counters.oversized_buffers.load(memory_order_relaxed)},
+        {"mappings", mapping_counters_json(counters.mappings)}
+    };
+}
+
+json timeouts_json(size_t idle, size_t header, size_t body, size_t write) {
+    return {{"idle", idle}, {"header", header}, {"body", body}, {"write", write}};
+}
+
+// Add one worker's pool counters into a local total.
+void accumulate(BufferPool::Counters &total, const BufferPool::Counters &counters) {
+    auto add = [](atomic<size_t> &sum, const atomic<size_t> &value) {
+        sum.store(sum.load(memory_order_relaxed) + value.load(memory_order_relaxed), memory_order_relaxed);
+    };
+    add(total.buffers_in_use, counters.buffers_in_use);
+    add(total.buffers_total, counters.buffers_total);
+    add(total.bytes_in_use, counters.bytes_in_use);
+    add(total.bytes_reserved, counters.bytes_reserved);
+    add(total.oversized_buffers, counters.oversized_buffers);
+    add(total.mappings.hugetlb_mappings, counters.mappings.hugetlb_mappings);
+    add(total.mappings.thp_mappings, counters.mappings.thp_mappings);
+    add(total.mappings.small_page_mappings, counters.mappings.small_page_mappings);
+    add(total.mappings.fallbacks, counters.mappings.fallbacks);
+    add(total.mappings.mapped_bytes, counters.mappings.mapped_bytes);
+}
+
+// -------------------------
+// PreforkSegment Class
+// -------------------------
+// Shared memory for prefork mode, mapped by the master before it forks so
+// every worker process sees the same pages. Each process has a slot with
+// its admission counters and one WorkerStats block per I/O thread; a
+// process writes only to its own slot and reads all of them, as threads do
+// with their stats blocks. Everything in it is a lock-free atomic, which
+// works the same across processes as across threads.
+class PreforkSegment {
+public:
+    PreforkSegment(size_t processes, size_t threads, const ServerConfig &config)
+        : processes_(processes), threads_(threads),
+          max_connections_(share_limit(config.max_connections, processes)),
+          max_in_flight_(share_limit(config.max_in_flight, processes)),
+          size_(processes * (sizeof(ProcessSlot) + threads * sizeof(WorkerStats))) {
+        void *memory = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            throw system_error(errno, generic_category(), "mmap(MAP_SHARED)");
+        }
+        slots_ = static_cast<ProcessSlot *>(memory);
+        workers_ = reinterpret_cast<WorkerStats *>(slots_ + processes);
+        for (size_t p = 0; p < processes; ++p) {
+            new (&slots_[p]) ProcessSlot(max_connections_, max_in_flight_);
+            for (size_t t = 0; t < threads; ++t) {
+                new (&worker(p, t)) WorkerStats();
+            }
+        }
+    }
+
+    ~PreforkSegment() {
+        munmap(slots_, size_);
+    }
+
+    PreforkSegment(const PreforkSegment &) = delete;
+    PreforkSegment &operator=(const PreforkSegment &) = delete;
+
+    // Clear a slot for a replacement process: the one before it may have
+    // died holding connections it never gave back.
+    void reset(size_t process) {
+        slots_[process].~ProcessSlot();
+        new (&slots_[process]) ProcessSlot(max_connections_, max_in_flight_);
+        for (size_t t = 0; t < threads_; ++t) {
+            worker(process, t).~WorkerStats();
+            new (&worker(process, t)) WorkerStats();
         }
     }
-    
-    void start_accept() {
-        acceptor_.async_accept(
-            [this](boost::system::error_code ec, tcp::socket socket) {
-                if (!ec) {
-                    thread([this, s = std::move(socket)]() mutable {
-                        handle_connection(std::move(s));
-                    }).detach();
+
+    void set_pid(size_t process, pid_t pid) { slots_[process].pid.store(pid, memory_order_relaxed); }
+    pid_t pid(size_t process) const { return slots_[process].pid.load(memory_order_relaxed); }
+    AdmissionControl &admission(size_t process) { return slots_[process].admission; }
+    WorkerStats &worker(size_t process, size_t thread) { return workers_[process * threads_ + thread]; }
+    size_t processes() const { return processes_; }
+    size_t threads() const { return threads_; }
+
+private:
+    // Limits are per process, each an equal share of the server-wide one.
+    static size_t share_limit(size_t limit, size_t processes) {
+        return limit == 0 ? 0 : (limit + processes - 1) / processes;
+    }
+
+    struct alignas(64) ProcessSlot {
+        ProcessSlot(size_t max_connections, size_t max_in_flight) : admission(max_connections, max_in_flight) {}
+        AdmissionControl admission;
+        atomic<pid_t> pid{0};
+    };
+
+    const size_t processes_;
+    const size_t threads_;
+    const size_t max_connections_;
+    const size_t max_in_flight_;
+    const size_t size_;
+    ProcessSlot *slots_ = nullptr;
+    WorkerStats *workers_ = nullptr;
+};
+
+class ServerStats {
+public:
+    // The counters live in this process, or with config.prefork set in the
+    // shared segment: this process then updates its own slot and reports
+    // every process's.
+    ServerStats(const ServerConfig &config, size_t num_workers) : prefork_(config.prefork) {
+        if (prefork_) {
+            for (size_t p = 0; p < prefork_->processes(); ++p) {
+                admissions_.push_back(&prefork_->admission(p));
+                for (size_t t = 0; t < prefork_->threads(); ++t) {
+                    workers_.push_back(&prefork_->worker(p, t));
                 }
-                start_accept();
             }
-        );
+            admission_ = admissions_[config.process_index];
+            first_worker_ = config.process_index * prefork_->threads();
+            num_workers_ = prefork_->threads();
+            return;
+        }
+        owned_admission_ = make_unique<AdmissionControl>(config.max_connections, config.max_in_flight);
+        admission_ = owned_admission_.get();
+        admissions_.push_back(admission_);
+        for (size_t i = 0; i < num_workers; ++i) {
+            owned_workers_.push_back(make_unique<WorkerStats>());
+            workers_.push_back(owned_workers_.back().get());
+        }
+        num_workers_ = num_workers;
+    }
+
+    // This process's admission counters and I/O thread stats.
+    AdmissionControl &admission() { return *admission_; }
+    WorkerStats &worker(size_t index) { return *workers_[first_worker_ + index]; }
+    size_t size() const { return num_workers_; }
+
+    // Merge the per-worker counters. Only called when someone asks for stats.
+    json snapshot() const {
+        size_t connections_accepted = 0;
+        size_t requests_served = 0;
+        size_t connections = 0, in_flight = 0;
+        for (auto *admission : admissions_) {
+            connections += admission->connections();
+            in_flight += admission->in_flight();
+        }
+        size_t io_syscalls = 0;
+        size_t allocations = 0;
+        BufferPool::Counters receive_buffers;
+        size_t idle_timeouts = 0, header_timeouts = 0, body_timeouts = 0, write_timeouts = 0;
+        size_t admitted = 0, queued = 0, shed_connections = 0, shed_in_flight = 0, shed_queue_delay = 0;
+        LatencyHistogram wakeup_latency;
+        json per_worker = json::array();
+        for (auto &worker : workers_) {
+            size_t accepted = worker->connections_accepted.load(memory_order_relaxed);
+            size_t served = worker->requests_served.load(memory_order_relaxed);
+            size_t syscalls = worker->io_syscalls.load(memory_order_relaxed);
+            size_t allocated = worker->allocations.load(memory_order_relaxed);
+            allocations += allocated;
+            connections_accepted += accepted;
+            requests_served += served;
+            io_syscalls += syscalls;
+            size_t idle = worker->idle_timeouts.load(memory_order_relaxed);
+            size_t header = worker->header_timeouts.load(memory_order_relaxed);
+            size_t body = worker->body_timeouts.load(memory_order_relaxed);
+            size_t write = worker->write_timeouts.load(memory_order_relaxed);
+            admitted += worker->admitted_requests.load(memory_order_relaxed);
+            queued += worker->queued_requests.load(memory_order_relaxed);
+            shed_connections += worker->shed_connections.load(memory_order_relaxed);
+            shed_in_flight += worker->shed_in_flight.load(memory_order_relaxed);
+            shed_queue_delay += worker->shed_queue_delay.load(memory_order_relaxed);
+            idle_timeouts += idle;
+            header_timeouts += header;
+            body_timeouts += body;
+            write_timeouts += write;
+            accumulate(receive_buffers, worker->receive_buffers);
+            wakeup_latency.merge(worker->wakeup_latency);
+            per_worker.push_back({{"connections_accepted", accepted}, {"requests_served", served},
+                                  {"io_syscalls", syscalls}, {"allocations", allocated},
+                                  {"receive_buffers", buffer_pool_json(worker->receive_buffers)},
+                                  {"timeouts", timeouts_json(idle, header, body, write)},
+                                  {"wakeup_latency_us", latency_summary_us(worker->wakeup_latency)}});
+        }
+        json result;
+        result["pid"]                  = getpid();
+        result["workers"]              = workers_.size();
+        result["connections_accepted"] = connections_accepted;
+        result["requests_served"]      = requests_served;
+        result["io_syscalls"]          = io_syscalls;
+        result["allocations"]          = allocations;
+        result["receive_buffers"]      = buffer_pool_json(receive_buffers);
+        result["timeouts"]             = timeouts_json(idle_timeouts, header_timeouts, body_timeouts, write_timeouts);
+        result["admission"]            = {
+            {"accepted", admitted},
+            {"queued", queued},
+            {"shed", {{"connections", shed_connections}, {"in_flight", shed_in_flight},
+                      {"queue_delay", shed_queue_delay}}},
+            {"connections", connections},
+            {"in_flight", in_flight}
+        };
+        result["wakeup_latency_us"]    = latency_summary_us(wakeup_latency);
+        result["per_worker"]           = per_worker;
+        if (prefork_) {
+            json processes = json::array();
+            for (size_t p = 0; p < prefork_->processes(); ++p) {
+                processes.push_back({{"pid", prefork_->pid(p)},
+                                     {"connections", admissions_[p]->connections()},
+                                     {"in_flight", admissions_[p]->in_flight()}});
+            }
+            result["processes"] = processes;
+        }
+        return result;
     }
-    
-    tcp::acceptor acceptor_;
+
+private:
+    PreforkSegment *prefork_;
+    unique_ptr<AdmissionControl> owned_admission_;
+    vector<unique_ptr<WorkerStats>> owned_workers_;
+    AdmissionControl *admission_ = nullptr;
+    vector<AdmissionControl *> admissions_;   // every process's
+    vector<WorkerStats *> workers_;           // every process's, process by process
+    size_t first_worker_ = 0;
+    size_t num_workers_ = 0;
 };
 
-int main() {
-    try {
-        boost::asio::io_context io_context;
-        HTTPServer server(io_context, 8080);
-        io_context.run();
+// -------------------------
+// IoContextPool Class
+// -------------------------
+// A fixed set of io_contexts, one per worker thread. New connections are
+// handed out round-robin so every socket stays on a single thread for its
+// whole lifetime and its handlers never need a strand.
+class IoContextPool {
+public:
+    explicit IoContextPool(size_t pool_size) {
+        if (pool_size == 0) {
+            throw runtime_error("IoContextPool size must be at least 1");
+        }
+        for (size_t i = 0; i < pool_size; ++i) {
+            io_contexts_.push_back(make_unique<boost::asio::io_context>(1));
+            work_.push_back(boost::asio::make_work_guard(*io_contexts_.back()));
+        }
+    }
+
+    // Runs every io_context on its own thread; join() waits for all of them
+    // to stop. Thread i is pinned to cpus[i % cpus.size()] when cpus is not
+    // empty.
+    void start(ServerConfig::PollMode mode, microseconds spin_before_block, const vector<int> &cpus) {
+        for (size_t i = 0; i < io_contexts_.size(); ++i) {
+            auto &io_context = io_contexts_[i];
+            int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+            threads_.emplace_back([&io_context, mode, spin_before_block, cpu]() {
+                if (cpu >= 0 && !cpu_affinity::pin_current_thread(cpu)) {
+                    cerr << "Could not pin I/O thread to CPU " << cpu << endl;
+                }
+                if (mode == ServerConfig::PollMode::block) {
+                    io_context->run();
+                } else {
+                    run_polling(*io_context, mode, spin_before_block);
+                }
+            });
+        }
+    }
+
+    void join() {
+        for (auto &t : threads_) {
+            t.join();
+        }
+        threads_.clear();
+    }
+
+    void stop() {
+        for (auto &io_context : io_contexts_) {
+            io_context->stop();
+        }
+    }
+
+    // Index of the next io_context in round-robin order. Only called from the
+    // shared accept path, which runs on a single thread.
+    size_t next_index() {
+        size_t index = next_;
+        next_ = (next_ + 1) % io_contexts_.size();
+        return index;
+    }
+
+    boost::asio::io_context &get_io_context(size_t index) {
+        return *io_contexts_[index];
+    }
+
+    size_t size() const { return io_contexts_.size(); }
+
+private:
+    // Busy loop over poll(), which runs ready handlers and returns without
+    // waiting. In hybrid mode a thread that found nothing to do for
+    // spin_before_block blocks in run_one() until the next handler.
+    static void run_polling(boost::asio::io_context &io_context, ServerConfig::PollMode mode,
+                            microseconds spin_before_block) {
+        auto idle_since = steady_clock::now();
+        while (!io_context.stopped()) {
+            if (io_context.poll() > 0) {
+                if (mode == ServerConfig::PollMode::hybrid) {
+                    idle_since = steady_clock::now();
+                }
+                continue;
+            }
+            if (mode == ServerConfig::PollMode::hybrid &&
+                steady_clock::now() - idle_since >= spin_before_block) {
+                io_context.run_one();
+                idle_since = steady_clock::now();
+            }
+        }
+    }
+
+    using work_guard = boost::asio::executor_work_guard<boost::asio::io_context::executor_type>;
+
+    vector<unique_ptr<boost::asio::io_context>> io_contexts_;
+    vector<work_guard> work_;
+    vector<thread> threads_;
+    size_t next_ = 0;
+};
+
+// -------------------------
+// Per-Worker Request State
+// -------------------------
+// An I/O thread parses and dispatches one request at a time, so what is only
+// needed for that step is kept once per thread instead of in every
+// connection: the parser, route parameters, the arena request bodies are
+// parsed into, and the JSON serializer. A connection keeps its socket, a
+// ReceiveBuffer that holds no memory between requests, and what a response
+// in flight needs.
+enum class Framing { ready, need_more, bad_request, header_too_large, body_too_large };
+
+class RequestScratch {
+public:
+    RequestScratch(BufferPool::Counters &counters, huge_pages::Mode huge_pages)
+        : buffers(counters, huge_pages) {}
+
+    RequestScratch(const RequestScratch &) = delete;
+    RequestScratch &operator=(const RequestScratch &) = delete;
+
+    // Look for a complete request at the front of input. request_size is the
+    // connection's note of that request's total size, 0 until its head has
+    // been parsed. On ready, parser holds the request. The parser resumes
+    // where it stopped only if the same connection called last and its bytes
+    // have not moved; otherwise the head is parsed again from the start.
+    Framing frame_request(const void *owner, const ReceiveBuffer &input, size_t &request_size,
+                          const ServerConfig &config) {
+        if (input.empty()) {
+            return Framing::need_more;
+        }
+        if (request_size == 0) {
+            auto result = parse(owner, input.data(), input.size());
+            if (result == HttpRequestParser::Result::incomplete) {
+                return input.size() >= config.max_header_size ? reject(owner, Framing::header_too_large)
+                                                                : Framing::need_more;
+            }
+            if (result == HttpRequestParser::Result::error) {
+                return reject(owner, Framing::bad_request);
+            }
+            if (parser.head_size() > config.max_header_size) {
+                return reject(owner, Framing::header_too_large);
+            }
+            if (parser.request().content_length > config.max_body_size) {
+                return reject(owner, Framing::body_too_large);
+            }
+            request_size = parser.head_size() + parser.request().content_length;
+        }
+        if (input.size() < request_size) {
+            return Framing::need_more;
+        }
+        if (!complete_ || owner_ != owner || data_ != input.data()) {
+            parse(owner, input.data(), input.size());
+        }
+        return Framing::ready;
+    }
+
+    // Drop the parser state and arena contents once the request has been
+    // dispatched.
+    void finish_request() {
+        release(owner_);
+        arena.reset();
+    }
+
+    // Forget a connection that is going away; its memory may be reused by
+    // the next one.
+    void release(const void *owner) {
+        if (owner_ == owner) {
+            parser.reset();
+            owner_ = nullptr;
+            data_ = nullptr;
+            complete_ = false;
+        }
+    }
+
+    // Serialize into out, which must outlive the write that sends it. The
+    // serializer and its output string are reused, so this only allocates
+    // while out is still growing.
+    void serialize(const json &data, string &out) {
+        json_text_.clear();
+        json_serializer_.dump(data, false, false, 0);
+        out.assign(json_text_);
+    }
+
+    BufferPool buffers;
+    HttpRequestParser parser;
+    RouteParams route_params;
+    MonotonicArena arena;
+
+private:
+    HttpRequestParser::Result parse(const void *owner, const char *data, size_t size) {
+        if (owner != owner_ || data != data_ || complete_) {
+            parser.reset();
+            owner_ = owner;
+            data_ = data;
+        }
+        auto result = parser.parse(data, size);
+        complete_ = (result == HttpRequestParser::Result::complete);
+        return result;
+    }
+
+    Framing reject(const void *owner, Framing framing) {
+        release(owner);
+        return framing;
+    }
+
+    const void *owner_ = nullptr;
+    const char *data_ = nullptr;
+    bool complete_ = false;
+    string json_text_;
+    nlohmann::detail::serializer<json> json_serializer_{
+        nlohmann::detail::output_adapter<char>(json_text_), ' '};
+};
+
+// -------------------------
+// Connection Deadlines
+// -------------------------
+// A connection is in one phase at a time, and every phase except running a
+// handler has a deadline: idle between requests (keep_alive_timeout),
+// receiving a head once its first byte is in, receiving the body, and
+// sending the response. A deadline is set when its phase starts and is not
+// pushed back by progress within it, so a client trickling bytes cannot
+// hold a connection open. All of a thread's deadlines live in one
+// TimingWheel that the thread advances each tick while any are armed.
+enum class Deadline { none, idle, header, body, write };
+
+// The phase of a connection that is waiting for more of a request.
+Deadline receive_phase(const ReceiveBuffer &input, size_t request_size) {
+    return input.empty() ? Deadline::idle : request_size == 0 ? Deadline::header : Deadline::body;
+}
+
+class ConnectionDeadline {
+public:
+    ConnectionDeadline(WheelTimer::Callback on_expiry, void *connection) : timer_(on_expiry, connection) {}
+
+    Deadline phase() const { return phase_; }
+
+private:
+    friend class DeadlineWheel;
+
+    WheelTimer timer_;
+    Deadline phase_ = Deadline::none;
+};
+
+class DeadlineWheel {
+public:
+    DeadlineWheel(const ServerConfig &config, WorkerStats &stats) : config_(config), stats_(stats) {}
+
+    // Move a connection to phase, arming that phase's deadline unless it is
+    // already there. The owner keeps the wheel ticking while it is not empty.
+    void enter(ConnectionDeadline &deadline, Deadline phase) {
+        if (phase == deadline.phase_) {
+            return;
+        }
+        deadline.phase_ = phase;
+        if (phase == Deadline::none) {
+            wheel_.cancel(deadline.timer_);
+        } else {
+            wheel_.schedule(deadline.timer_, timeout(phase));
+        }
+    }
+
+    // For a connection's expiry callback: count the timeout and return the
+    // phase that ran out.
+    Deadline expired(ConnectionDeadline &deadline) {
+        Deadline phase = deadline.phase_;
+        deadline.phase_ = Deadline::none;
+        atomic<size_t> &counter = phase == Deadline::idle   ? stats_.idle_timeouts
+                                : phase == Deadline::header ? stats_.header_timeouts
+                                : phase == Deadline::body   ? stats_.body_timeouts
+                                                            : stats_.write_timeouts;
+        counter.store(counter.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        return phase;
+    }
+
+    // Expire every deadline that is due, as one batch. Returns true while
+    // some are still armed.
+    bool tick() {
+        wheel_.advance(TimingWheel::Clock::now());
+        return !wheel_.empty();
+    }
+
+private:
+    milliseconds timeout(Deadline phase) const {
+        switch (phase) {
+        case Deadline::header: return config_.header_timeout;
+        case Deadline::body:   return config_.body_timeout;
+        case Deadline::write:  return config_.write_timeout;
+        default:               return config_.keep_alive_timeout;
+        }
+    }
+
+    const ServerConfig &config_;
+    WorkerStats &stats_;
+    TimingWheel wheel_;
+};
+
+// -------------------------
+// Admission Control
+// -------------------------
+// One I/O thread's side of admission control: the shared connection and
+// in-flight limits plus the thread's own queue delay shedder, with every
+// decision counted. The queue delay samples are the lateness of the
+// deadline wheel's tick, which runs whenever connections are waiting on it.
+class WorkerAdmission {
+public:
+    WorkerAdmission(AdmissionControl &shared, const ServerConfig &config, WorkerStats &stats)
+        : shared_(shared), stats_(stats), shedder_(config.shed_target, config.shed_interval) {}
+
+    // Returns false if the connection must be refused; otherwise the
+    // connection calls close_connection() when it goes away.
+    bool open_connection() {
+        if (shared_.open_connection()) {
+            return true;
+        }
+        bump(stats_.shed_connections);
+        return false;
+    }
+
+    void close_connection() { shared_.close_connection(); }
+
+    // Decide on a complete request. Returns false if it must be shed;
+    // otherwise finish_request() is due once it has been answered.
+    bool admit_request() {
+        if (shedder_.shedding()) {
+            bump(stats_.shed_queue_delay);
+            return false;
+        }
+        if (!shared_.admit_request()) {
+            bump(stats_.shed_in_flight);
+            return false;
+        }
+        bump(stats_.admitted_requests);
+        if (shedder_.above_target()) {
+            bump(stats_.queued_requests);
+        }
+        return true;
+    }
+
+    void finish_request() { shared_.finish_request(); }
+
+    // The server is shutting down or handing over: keep-alive is off.
+    bool draining() const { return shared_.draining(); }
+
+    void record_queue_delay(steady_clock::time_point now, steady_clock::duration delay) {
+        shedder_.record(now, delay);
+    }
+
+    // No samples are coming for a while.
+    void stop_sampling() { shedder_.reset(); }
+
+private:
+    static void bump(atomic<size_t> &counter) {
+        counter.store(counter.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+
+    AdmissionControl &shared_;
+    WorkerStats &stats_;
+    QueueDelayShedder shedder_;
+};
+
+// -------------------------
+// Job Threads
+// -------------------------
+// The threads an I/O worker starts for blocking jobs. A job refers to its
+// worker and its connection until its result has been handed back, so the
+// server joins them once its I/O threads have stopped and before anything
+// is torn down: a stopping server waits for jobs still running rather than
+// freeing what they use. Finished threads are joined as new ones start.
+class JobThreads {
+public:
+    ~JobThreads() { join(); }
+
+    template <typename F>
+    void start(F &&job) {
+        lock_guard<mutex> lock(m_);
+        reap();
+        Job &entry = jobs_.emplace_back();
+        entry.worker = thread([&entry, job = std::forward<F>(job)]() mutable {
+            job();
+            entry.done.store(true, memory_order_release);
+        });
+    }
+
+    size_t running() {
+        lock_guard<mutex> lock(m_);
+        reap();
+        return jobs_.size();
+    }
+
+    // Waits for every job started so far.
+    void join() {
+        list<Job> jobs;
+        {
+            lock_guard<mutex> lock(m_);
+            jobs.swap(jobs_);
+        }
+        for (auto &job : jobs) {
+            job.worker.join();
+        }
+    }
+
+private:
+    struct Job {
+        thread worker;
+        atomic<bool> done{false};
+    };
+
+    void reap() {
+        for (auto it = jobs_.begin(); it != jobs_.end();) {
+            if (it->done.load(memory_order_acquire)) {
+                it->worker.join();
+                it = jobs_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    mutex m_;
+    list<Job> jobs_;  // nodes stay put, so each thread can flag its own
+};
+
+// Waits for the jobs of every worker of a stopping server.
+void join_jobs(const vector<JobThreads *> &jobs) {
+    size_t running = 0;
+    for (JobThreads *worker_jobs : jobs) {
+        running += worker_jobs->running();
+    }
+    if (running > 0) {
+        cerr << "Waiting for " << running << " jobs still running" << endl;
+    }
+    for (JobThreads *worker_jobs : jobs) {
+        worker_jobs->join();
+    }
+}
+
+// -------------------------
+// ServerWorker
+// -------------------------
+// State owned by one I/O thread and shared by every connection on it. Apart
+// from the stats block, which readers merge, it is only touched from that
+// thread, so none of it needs locking.
+class ServerWorker {
+public:
+    ServerWorker(boost::asio::io_context &io_context, const ServerConfig &config, WorkerStats &stats,
+                 AdmissionControl &admission)
+        : io_context_(io_context), stats_(stats), scratch_(stats.receive_buffers, config.huge_pages),
+          deadlines_(config, stats), admission_(admission, config, stats), date_timer_(io_context),
+          probe_timer_(io_context), wheel_timer_(io_context), probe_interval_(config.wakeup_probe_interval) {
+        boost::asio::post(io_context_, [this]() { t_allocation_counter = &stats_.allocations; });
+        schedule_date_refresh();
+        if (probe_interval_.count() > 0) {
+            schedule_wakeup_probe();
+        }
+    }
+
+    boost::asio::io_context &io_context() { return io_context_; }
+    WorkerStats &stats() { return stats_; }
+    RequestScratch &scratch() { return scratch_; }
+    const DateCache &date() const { return date_; }
+
+    void set_deadline(ConnectionDeadline &deadline, Deadline phase) {
+        deadlines_.enter(deadline, phase);
+        if (phase != Deadline::none && !wheel_ticking_) {
+            wheel_ticking_ = true;
+            schedule_wheel_tick();
+        }
+    }
+
+    DeadlineWheel &deadlines() { return deadlines_; }
+    WorkerAdmission &admission() { return admission_; }
+    JobThreads &jobs() { return jobs_; }
+
+private:
+    // Advance the deadline wheel every tick while it has deadlines armed; an
+    // empty wheel costs no wake-ups. How late the tick runs is the queue
+    // delay sample for admission control.
+    void schedule_wheel_tick() {
+        wheel_timer_.expires_after(TimingWheel::kTick);
+        wheel_timer_.async_wait(make_custom_alloc_handler(wheel_memory_, [this](boost::system::error_code ec) {
+            if (ec) {
+                return;
+            }
+            auto now = steady_clock::now();
+            admission_.record_queue_delay(now, now - wheel_timer_.expiry());
+            if (deadlines_.tick()) {
+                schedule_wheel_tick();
+                return;
+            }
+            wheel_ticking_ = false;
+            admission_.stop_sampling();
+        }));
+    }
+
+    // Refresh the cached Date line just after each wall-clock second ticks over.
+    void schedule_date_refresh() {
+        auto since_epoch = system_clock::now().time_since_epoch();
+        auto into_second = since_epoch - duration_cast<seconds>(since_epoch);
+        date_timer_.expires_after(seconds(1) - into_second);
+        date_timer_.async_wait([this](boost::system::error_code ec) {
+            if (ec) {
+                return;
+            }
+            date_.refresh();
+            schedule_date_refresh();
+        });
+    }
+
+    // A periodic timer whose lateness is the thread's wake-up latency: the
+    // time from an event becoming due to its handler running.
+    void schedule_wakeup_probe() {
+        probe_timer_.expires_after(probe_interval_);
+        probe_timer_.async_wait([this](boost::system::error_code ec) {
+            if (ec) {
+                return;
+            }
+            auto late = steady_clock::now() - probe_timer_.expiry();
+            stats_.wakeup_latency.record(static_cast<uint64_t>(duration_cast<nanoseconds>(late).count()));
+            schedule_wakeup_probe();
+        });
+    }
+
+    boost::asio::io_context &io_context_;
+    WorkerStats &stats_;
+    RequestScratch scratch_;
+    DeadlineWheel deadlines_;
+    WorkerAdmission admission_;
+    DateCache date_;
+    HandlerMemory<128> wheel_memory_;
+    boost::asio::steady_timer date_timer_;
+    boost::asio::steady_timer probe_timer_;
+    boost::asio::steady_timer wheel_timer_;
+    bool wheel_ticking_ = false;
+    microseconds probe_interval_;
+    JobThreads jobs_;
+};
+
+// Fixed responses, serialized once at startup and shared by every thread.
+const CannedResponse kPreflightResponse(200, http_headers::kCors, "");
+const CannedResponse kHealthResponse(200, http_headers::kJson, R"({"status":"ok"})");
+const CannedResponse kBadRequestResponse(400, http_headers::kJson, R"({"error":"Bad Request"})");
+const CannedResponse kNotFoundResponse(404, http_headers::kJson, R"({"error":"Not Found"})");
+const CannedResponse kMethodNotAllowedResponse(405, http_headers::kJson, R"({"error":"Method Not Allowed"})");
+const CannedResponse kPayloadTooLargeResponse(413, http_headers::kJson, R"({"error":"Payload Too Large"})");
+const CannedResponse kHeaderTooLargeResponse(431, http_headers::kJson,
+                                             R"({"error":"Request Header Fields Too Large"})");
+
+const CannedResponse kServiceUnavailableResponse(503, http_headers::kJsonRetryAfter,
+                                                 R"({"error":"Service Unavailable"})");
+
+// The response for a request frame_request() refused; the connection is
+// closed after it.
+const CannedResponse &framing_error_response(Framing framing) {
+    switch (framing) {
+    case Framing::header_too_large: return kHeaderTooLargeResponse;
+    case Framing::body_too_large:   return kPayloadTooLargeResponse;
+    default:                        return kBadRequestResponse;
+    }
+}
+
+// Refuse a connection over the limit without building any state for it:
+// take whatever part of the request has already arrived, so that closing
+// sends a FIN rather than a reset, then send the 503 and shut down the
+// sending side; the caller closes the socket. Nothing here blocks; a client
+// that cannot take the response at once only sees the close.
+void shed_connection(int fd, const DateCache &date) {
+    char discard[4096];
+    for (int i = 0; i < 4 && recv(fd, discard, sizeof(discard), MSG_DONTWAIT) > 0; ++i) {
+    }
+    string_view status_line = kServiceUnavailableResponse.status_line();
+    string_view date_line = date.line();
+    string_view rest = kServiceUnavailableResponse.rest(false);
+    iovec iov[3] = {{const_cast<char *>(status_line.data()), status_line.size()},
+                    {const_cast<char *>(date_line.data()), date_line.size()},
+                    {const_cast<char *>(rest.data()), rest.size()}};
+    msghdr msg{};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 3;
+    ssize_t ignored = sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    (void)ignored;
+    shutdown(fd, SHUT_WR);
+}
+
+// -------------------------
+// Request Routing
+// -------------------------
+// The response of a job or a coroutine handler: a JSON body, or one of the
+// canned responses if canned is set.
+struct JobResult {
+    json body;
+    int status_code = 200;
+    const CannedResponse *canned = nullptr;
+};
+
+// A request handed to a coroutine handler. The handler can suspend while
+// its I/O thread goes on to parse other requests into the worker's scratch,
+// so the request is copied out of it into storage the connection keeps,
+// and whose capacity it reuses, until the response has been sent.
+class CoroutineRequest {
+public:
+    explicit CoroutineRequest(const ServerConfig &config) : config_(config) {}
+
+    void assign(const HttpRequest &request, const RouteParams &params, string_view body) {
+        method_ = parse_method(request.method);
+        path_.assign(request.path);
+        body_.assign(body);
+        // Captured values point into the parser's copy of the path.
+        params_.clear();
+        for (size_t i = 0; i < params.size(); ++i) {
+            string_view value = params.value(i);
+            params_.push(params.name(i), string_view(path_).substr(value.data() - request.path.data(), value.size()));
+        }
+    }
+
+    HttpMethod method() const { return method_; }
+    string_view path() const { return path_; }
+    const RouteParams &params() const { return params_; }
+    string_view body() const { return body_; }
+    const ServerConfig &server_config() const { return config_; }
+
+private:
+    const ServerConfig &config_;
+    HttpMethod method_ = HttpMethod::unknown;
+    string path_;
+    RouteParams params_;
+    string body_;
+};
+
+// A route handler written as a coroutine on an asio executor. It can await
+// socket reads and writes, timers or calls to other servers without
+// blocking its thread, and co_returns the response.
+using CoroutineHandler = awaitable<JobResult> (*)(CoroutineRequest &);
+
+// What a route handler can do with the connection that received the request.
+// Each network backend implements it, so routes are written once.
+class RouteContext {
+public:
+    virtual ~RouteContext() = default;
+
+    virtual void send_json_response(const json &data, int status_code) = 0;
+    virtual void write_canned(const CannedResponse &response) = 0;
+    // Run blocking work off the I/O thread; its result is sent from the
+    // connection's own thread once it is done.
+    virtual void run_job(function<JobResult()> job) = 0;
+    // Start a coroutine handler; its response is sent when it completes.
+    virtual void run_coroutine(CoroutineHandler handler, const HttpRequest &request, const RouteParams &params,
+                               string_view body) = 0;
+    virtual void close_after_response() = 0;
+    virtual const ServerStats &server_stats() const = 0;
+    virtual const ServerConfig &server_config() const = 0;
+};
+
+using RouteHandler = void (*)(RouteContext &, const HttpRequest &, const RouteParams &, string_view body);
+
+void send_result(RouteContext &context, const JobResult &result) {
+    if (result.canned) {
+        context.write_canned(*result.canned);
+    } else {
+        context.send_json_response(result.body, result.status_code);
+    }
+}
+
+// The result of a coroutine handler, or a 500 if it threw.
+JobResult coroutine_result(exception_ptr error, JobResult result) {
+    if (error) {
+        result = JobResult{};
+        result.status_code = 500;
+        try {
+            rethrow_exception(error);
+        } catch (exception &e) {
+            result.body["error"] = e.what();
+        } catch (...) {
+            result.body["error"] = "Internal Server Error";
+        }
+    }
+    return result;
+}
+
+// -------------------------
+// CoroutineRunner Class
+// -------------------------
+// Runs one connection's coroutine handlers, one at a time, from a loop
+// coroutine spawned for its first one. A co_spawn per request would
+// allocate its entry frame and two operations every time. From the loop,
+// each handler's frame comes from asio's per-thread frame cache, which the
+// loop's own long-lived frame leaves free, and the wait for the next
+// request reuses its operation's memory. Between requests the loop waits
+// on a timer that never expires; cancelling the wait wakes it. Only used
+// from the executor's thread.
+class CoroutineRunner : public enable_shared_from_this<CoroutineRunner> {
+public:
+    CoroutineRunner(const boost::asio::any_io_executor &executor, const ServerConfig &config,
+                    function<void(JobResult)> on_result)
+        : wakeup_(executor, boost::asio::steady_timer::time_point::max()), request_(config),
+          on_result_(std::move(on_result)) {}
+
+    // Filled in before run(), while no handler is running.
+    CoroutineRequest &request() { return request_; }
+
+    // Start handler on request(); on_result gets its response.
+    void run(CoroutineHandler handler) {
+        handler_ = handler;
+        if (!started_) {
+            started_ = true;
+            boost::asio::co_spawn(wakeup_.get_executor(), loop(shared_from_this()), boost::asio::detached);
+        } else {
+            wakeup_.cancel();
+        }
+    }
+
+    // The connection is gone; the loop ends instead of waiting again.
+    void stop() {
+        stopped_ = true;
+        wakeup_.cancel();
+    }
+
+private:
+    static awaitable<void> loop(shared_ptr<CoroutineRunner> self) {
+        while (!self->stopped_) {
+            if (!self->handler_) {
+                boost::system::error_code ignored;
+                co_await self->wakeup_.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ignored));
+                continue;
+            }
+            CoroutineHandler handler = exchange(self->handler_, nullptr);
+            JobResult result;
+            exception_ptr error;
+            try {
+                result = co_await handler(self->request_);
+            } catch (...) {
+                error = current_exception();
+            }
+            // May serve a pipelined request and call run() before returning.
+            self->on_result_(coroutine_result(error, std::move(result)));
+        }
+    }
+
+    boost::asio::steady_timer wakeup_;
+    CoroutineRequest request_;
+    function<void(JobResult)> on_result_;
+    CoroutineHandler handler_ = nullptr;
+    bool started_ = false;
+    bool stopped_ = false;
+};
+
+// The route table entry for a coroutine handler.
+template <CoroutineHandler Handler>
+void serve_coroutine(RouteContext &context, const HttpRequest &request, const RouteParams &params,
+                     string_view body) {
+    context.run_coroutine(Handler, request, params, body);
+}
+
+// POST /api/benchmark. The run blocks for its whole duration. The body is
+// parsed into the worker's arena; only the copy handed to the job thread
+// is on the heap.
+void handle_benchmark(RouteContext &context, const HttpRequest &, const RouteParams &, string_view body) {
+    json request_data;
+    {
+        ArenaJson parsed = ArenaJson::parse(body, nullptr, false);
+        if (!parsed.is_discarded()) {
+            request_data = to_heap_json(parsed);
+        }
+    }
+    if (request_data.is_null()) {
+        json err;
+        err["error"] = "Invalid JSON body";
+        context.send_json_response(err, 400);
+        return;
+    }
+    const ServerConfig &config = context.server_config();
+    context.run_job([request_data = std::move(request_data), &config]() {
+        JobResult result;
+        try {
+            result.body = run_benchmark(request_data, config.benchmark_cpus, config.huge_pages);
+            result.body["topology"]["server_io_cpus"] = cpu_list_json(config.io_cpus);
+        } catch (exception &e) {
+            result.body["error"] = e.what();
+            result.status_code = 400;
+        }
+        return result;
+    });
+}
+
+// GET /api/stats
+void handle_stats(RouteContext &context, const HttpRequest &, const RouteParams &, string_view) {
+    context.send_json_response(context.server_stats().snapshot(), 200);
+}
+
+// GET /api/health; a canned response, handy as a minimal-cost load target.
+void handle_health(RouteContext &context, const HttpRequest &, const RouteParams &, string_view) {
+    context.write_canned(kHealthResponse);
+}
+
+// GET /api/co/health; /api/health as a coroutine, to measure what the
+// coroutine machinery costs per request.
+awaitable<JobResult> co_health(CoroutineRequest &) {
+    JobResult result;
+    result.canned = &kHealthResponse;
+    co_return result;
+}
+
+// GET /api/co/upstream: fetch this server's own /api/health over a new
+// connection, written straight-line, and report how it went.
+awaitable<JobResult> co_upstream(CoroutineRequest &request) {
+    auto executor = co_await boost::asio::this_coro::executor;
+    tcp::socket upstream(executor);
+    auto started = steady_clock::now();
+    co_await upstream.async_connect(
+        tcp::endpoint(boost::asio::ip::address_v4::loopback(), request.server_config().port),
+        boost::asio::use_awaitable);
+    static constexpr string_view kRequest = "GET /api/health HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+    co_await boost::asio::async_write(upstream, boost::asio::buffer(kRequest), boost::asio::use_awaitable);
+    string response;
+    boost::system::error_code ec;
+    co_await boost::asio::async_read(upstream, boost::asio::dynamic_buffer(response),
+                                     boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    if (ec != boost::asio::error::eof) {
+        throw boost::system::system_error(ec);
+    }
+    JobResult result;
+    result.body["upstream_status_line"] = response.substr(0, response.find("\r\n"));
+    result.body["upstream_bytes"] = response.size();
+    result.body["upstream_us"] = duration_cast<microseconds>(steady_clock::now() - started).count();
+    co_return result;
+}
+
+// The route table, built on first use; servers call this at startup.
+const Router<RouteHandler> &server_routes() {
+    static constexpr RouteSpec<RouteHandler> kRoutes[] = {
+        {HttpMethod::POST, "/api/benchmark",   handle_benchmark},
+        {HttpMethod::GET,  "/api/stats",       handle_stats},
+        {HttpMethod::GET,  "/api/health",      handle_health},
+        {HttpMethod::GET,  "/api/co/health",   serve_coroutine<co_health>},
+        {HttpMethod::GET,  "/api/co/upstream", serve_coroutine<co_upstream>},
+    };
+    static const Router<RouteHandler> router(kRoutes);
+    return router;
+}
+
+// Answer one complete request.
+void dispatch_request(RouteContext &context, const HttpRequest &request, string_view body,
+                      RouteParams &params) {
+    if (request.chunked) {
+        context.close_after_response();
+        json err;
+        err["error"] = "Chunked request bodies are not supported";
+        context.send_json_response(err, 501);
+        return;
+    }
+
+    // Handle OPTIONS for CORS on every path.
+    HttpMethod method = parse_method(request.method);
+    if (method == HttpMethod::OPTIONS) {
+        context.write_canned(kPreflightResponse);
+        return;
+    }
+
+    auto match = server_routes().find(method, request.path, params);
+    switch (match.status) {
+    case Router<RouteHandler>::Status::found:
+        (*match.handler)(context, request, params, body);
+        return;
+    case Router<RouteHandler>::Status::method_not_allowed:
+        context.write_canned(kMethodNotAllowedResponse);
+        return;
+    case Router<RouteHandler>::Status::not_found:
+        context.write_canned(kNotFoundResponse);
+        return;
+    }
+}
+
+// Serve the request frame_request() just found at the front of input, with
+// the worker's arena current, then clear the per-request state.
+void dispatch_framed_request(RouteContext &context, RequestScratch &scratch, const ReceiveBuffer &input) {
+    const HttpRequest &request = scratch.parser.request();
+    string_view body(input.data() + scratch.parser.head_size(), request.content_length);
+    {
+        ArenaScope arena_scope(scratch.arena);
+        dispatch_request(context, request, body, scratch.route_params);
+    }
+    scratch.finish_request();
+}
+
+// -------------------------
+// HTTPConnection Class
+// -------------------------
+// One accepted socket on the asio backend. Every step is an async operation
+// on the socket's own io_context; the session keeps itself alive through
+// shared_from_this(). Connections are persistent: after each response the
+// next request is parsed from the same buffer, so pipelined requests that
+// arrived together are served without another read. Between requests the
+// connection holds no receive buffer; it waits for the socket to become
+// readable and only then takes one from the worker's pool.
+class HTTPConnection : public RouteContext, public enable_shared_from_this<HTTPConnection> {
+public:
+    HTTPConnection(tcp::socket socket, const ServerConfig &config,
+                   ServerWorker &worker, const ServerStats &server_stats)
+        : socket_(std::move(socket)), config_(config), worker_(worker), server_stats_(server_stats),
+          deadline_(&HTTPConnection::on_deadline, this), input_(worker.scratch().buffers) {}
+
+    // The connection was admitted by the server's accept loop.
+    ~HTTPConnection() override {
+        if (admitted_) {
+            worker_.admission().finish_request();
+        }
+        worker_.admission().close_connection();
+        worker_.scratch().release(this);
+        if (coroutine_runner_) {
+            coroutine_runner_->stop();
+        }
+    }
+
+    void start() {
+        boost::system::error_code ignored;
+        socket_.non_blocking(true, ignored);
+        process_buffer();
+    }
+
+    // body_ keeps its capacity, so once it has grown to the largest response
+    // seen this no longer allocates.
+    void send_json_response(const json &data, int status_code) override {
+        worker_.scratch().serialize(data, body_);
+        write_response(status_code, http_headers::kJson, body_);
+    }
+
+    void write_canned(const CannedResponse &response) override {
+        write_buffers(response_writer_.canned(response, keep_alive(), worker_.date()));
+    }
+
+    // The job gets its own thread, which the worker joins before it goes
+    // away, and its result is posted back to this connection's io_context.
+    void run_job(function<JobResult()> job) override {
+        auto self = shared_from_this();
+        worker_.jobs().start([this, self, job = std::move(job)]() {
+            JobResult result = job();
+            boost::asio::post(socket_.get_executor(), [this, self, result = std::move(result)]() {
+                send_result(*this, result);
+            });
+        });
+    }
+
+    // The coroutine runs on this connection's thread. Until it completes
+    // nothing else is in flight for the connection, which it keeps alive.
+    void run_coroutine(CoroutineHandler handler, const HttpRequest &request, const RouteParams &params,
+                       string_view body) override {
+        if (!coroutine_runner_) {
+            coroutine_runner_ = make_shared<CoroutineRunner>(socket_.get_executor(), config_, [this](JobResult result) {
+                auto self = std::move(coroutine_self_);
+                send_result(*this, result);
+            });
+        }
+        coroutine_self_ = shared_from_this();
+        coroutine_runner_->request().assign(request, params, body);
+        coroutine_runner_->run(handler);
+    }
+
+    void close_after_response() override {
+        keep_alive_ = false;
+    }
+
+    const ServerStats &server_stats() const override {
+        return server_stats_;
+    }
+
+    const ServerConfig &server_config() const override {
+        return config_;
+    }
+
+private:
+    // Serve the buffered request if it is complete; read more if not.
+    void process_buffer() {
+        RequestScratch &scratch = worker_.scratch();
+        Framing framing = scratch.frame_request(this, input_, request_size_, config_);
+        if (framing == Framing::need_more) {
+            read_more();
+            return;
+        }
+        if (framing != Framing::ready) {
+            keep_alive_ = false;
+            draining_ = true;
+            write_canned(framing_error_response(framing));
+            return;
+        }
+        worker_.set_deadline(deadline_, Deadline::none);
+        keep_alive_ = scratch.parser.request().keep_alive;
+        if (!worker_.admission().admit_request()) {
+            scratch.finish_request();
+            write_canned(kServiceUnavailableResponse);
+            return;
+        }
+        admitted_ = true;
+        worker_.stats().requests_served.fetch_add(1, memory_order_relaxed);
+        dispatch_framed_request(*this, scratch, input_);
+    }
+
+    // Continue a partly received request. The buffer grows, within the
+    // header and body limits, only if the request does not fit.
+    void read_more() {
+        if (input_.empty()) {
+            wait_for_request();
+            return;
+        }
+        worker_.set_deadline(deadline_, receive_phase(input_, request_size_));
+        input_.reserve(request_size_);
+        worker_.stats().io_syscalls.fetch_add(1, memory_order_relaxed);
+        auto self = shared_from_this();
+        socket_.async_read_some(
+            boost::asio::buffer(input_.tail(), input_.tail_size()),
+            make_custom_alloc_handler(io_memory_, [this, self](boost::system::error_code ec, size_t bytes) {
+                if (ec) {
+                    report_read_error(ec);
+                    return;
+                }
+                input_.commit(bytes);
+                process_buffer();
+            }));
+    }
+
+    // Start of a request. A non-blocking read picks it up if it is already
+    // here; otherwise the buffer goes back to the pool and the connection
+    // waits for the socket to become readable, under the idle deadline.
+    void wait_for_request() {
+        input_.reserve(0);
+        worker_.stats().io_syscalls.fetch_add(1, memory_order_relaxed);
+        boost::system::error_code ec;
+        size_t bytes = socket_.read_some(boost::asio::buffer(input_.tail(), input_.tail_size()), ec);
+        if (!ec) {
+            input_.commit(bytes);
+            process_buffer();
+            return;
+        }
+        input_.release();
+        if (ec != boost::asio::error::would_block) {
+            report_read_error(ec);
+            return;
+        }
+        worker_.set_deadline(deadline_, Deadline::idle);
+        worker_.stats().io_syscalls.fetch_add(1, memory_order_relaxed);
+        auto self = shared_from_this();
+        socket_.async_wait(tcp::socket::wait_read,
+            make_custom_alloc_handler(io_memory_, [this, self](boost::system::error_code ec) {
+                if (ec) {
+                    report_read_error(ec);
+                    return;
+                }
+                wait_for_request();
+            }));
+    }
+
+    static void report_read_error(const boost::system::error_code &ec) {
+        if (ec != boost::asio::error::eof && ec != boost::asio::error::operation_aborted &&
+            ec != boost::asio::error::bad_descriptor) {
+            cerr << "Error reading request: " << ec.message() << endl;
+        }
+    }
+
+    // A deadline ran out. A deadline is only armed while a read, wait or
+    // write is outstanding, and closing the socket aborts it; its handler
+    // then drops the last reference to the connection.
+    static void on_deadline(void *connection) {
+        auto *self = static_cast<HTTPConnection *>(connection);
+        self->worker_.deadlines().expired(self->deadline_);
+        boost::system::error_code ignored;
+        self->socket_.close(ignored);
+    }
+
+    // Drop the request that was just answered from the buffer, and give
+    // back its in-flight slot.
+    void finish_request() {
+        input_.consume(request_size_);
+        request_size_ = 0;
+        if (admitted_) {
+            admitted_ = false;
+            worker_.admission().finish_request();
+        }
+    }
+
+    // After refusing a request the client may still be sending it; closing
+    // with unread data would reset the connection, possibly before the
+    // client has read the response. So stop sending and discard input until
+    // the client closes or the idle deadline passes.
+    void linger_close() {
+        boost::system::error_code ignored;
+        socket_.shutdown(tcp::socket::shutdown_send, ignored);
+        input_.release();
+        worker_.set_deadline(deadline_, Deadline::idle);
+        discard_input();
+    }
+
+    void discard_input() {
+        input_.reserve(0);
+        auto self = shared_from_this();
+        socket_.async_read_some(
+            boost::asio::buffer(input_.tail(), input_.tail_size()),
+            make_custom_alloc_handler(io_memory_, [this, self](boost::system::error_code ec, size_t) {
+                if (ec) {
+                    return;
+                }
+                discard_input();
+            }));
+    }
+
+    // Write the response with a single gathered write, then either go back for
+    // the next request on this socket or close it. header_block and body must
+    // stay alive until the write completes.
+    void write_response(int status_code, string_view header_block, string_view body) {
+        write_buffers(response_writer_.build(status_code, header_block, body, keep_alive(), worker_.date()));
+    }
+
+    // Decided when the response goes out, so a request answered after the
+    // server started draining (a benchmark job, say) still says close.
+    bool keep_alive() {
+        keep_alive_ = keep_alive_ && !worker_.admission().draining();
+        return keep_alive_;
+    }
+
+    void write_buffers(const ResponseWriter::Buffers &buffers) {
+        worker_.set_deadline(deadline_, Deadline::write);
+        worker_.stats().io_syscalls.fetch_add(1, memory_order_relaxed);
+        auto self = shared_from_this();
+        boost::asio::async_write(socket_, buffers,
+            make_custom_alloc_handler(io_memory_, [this, self](boost::system::error_code ec, size_t) {
+                if (ec) {
+                    if (ec != boost::asio::error::operation_aborted) {
+                        cerr << "Error sending response: " << ec.message() << endl;
+                    }
+                    return;
+                }
+                finish_request();
+                if (keep_alive_) {
+                    process_buffer();
+                    return;
+                }
+                if (draining_) {
+                    linger_close();
+                    return;
+                }
+                boost::system::error_code ignored;
+                socket_.shutdown(tcp::socket::shutdown_both, ignored);
+                socket_.close(ignored);
+            }));
+    }
+
+    // Declared first so it outlives anything that could still reference it;
+    // sized for the largest read, wait or write.
+    HandlerMemory<384> io_memory_;
+    tcp::socket socket_;
+    const ServerConfig &config_;
+    ServerWorker &worker_;
+    const ServerStats &server_stats_;
+    ConnectionDeadline deadline_;
+    ReceiveBuffer input_;
+    size_t request_size_ = 0;  // of the request being served, once its head is parsed
+    bool keep_alive_ = false;
+    bool draining_ = false;    // a request was refused; linger before closing
+    bool admitted_ = false;    // the request being served holds an in-flight slot
+    ResponseWriter response_writer_;
+    string body_;
+    shared_ptr<CoroutineRunner> coroutine_runner_;  // made for the first coroutine request
+    shared_ptr<HTTPConnection> coroutine_self_;     // while a coroutine handler runs
+};
+
+// -------------------------
+// HTTPServer Class
+// -------------------------
+// In the default mode one acceptor hands each new socket to the next
+// io_context in round-robin order. With reuse_port every I/O thread owns an
+// SO_REUSEPORT listener and accepts, parses and responds on its own thread.
+class HTTPServer {
+public:
+    explicit HTTPServer(const ServerConfig &config)
+        : config_(config),
+          io_context_pool_(config.num_threads),
+          stats_(config, io_context_pool_.size()),
+          admission_(stats_.admission()) {
+        server_routes();
+        for (size_t i = 0; i < io_context_pool_.size(); ++i) {
+            auto make_worker = [&]() {
+                workers_.push_back(make_unique<ServerWorker>(io_context_pool_.get_io_context(i), config_,
+                                                             stats_.worker(i), admission_));
+            };
+            if (config.io_cpus.empty()) {
+                make_worker();
+            } else {
+                cpu_affinity::run_on_cpu(config.io_cpus[i % config.io_cpus.size()], make_worker);
+            }
+        }
+        tcp::endpoint endpoint(tcp::v4(), config.port);
+        size_t num_listeners = config.reuse_port ? io_context_pool_.size() : 1;
+        vector<int> inherited = take_inherited_listeners(config_, num_listeners);
+        for (size_t i = 0; i < num_listeners; ++i) {
+            int cpu = config.reuse_port ? listener_cpu(config, i) : -1;
+            acceptors_.push_back(make_listener(io_context_pool_.get_io_context(i), endpoint,
+                                               inherited.empty() ? -1 : inherited[i], cpu));
+        }
+        cout << "Server listening on port " << config.port
+             << " with " << io_context_pool_.size() << " I/O threads"
+             << (config.reuse_port ? " (SO_REUSEPORT listener per thread)" : "")
+             << ", " << poll_mode_name(config.poll_mode) << " polling"
+             << (inherited.empty() ? "" : " (listeners inherited)") << endl;
+        cout << "Socket options: " << socket_options::describe(listener_fds(), config.socket) << endl;
+        print_placement(config);
+        print_huge_pages(config);
+        print_admission(config);
+        for (size_t i = 0; i < acceptors_.size(); ++i) {
+            start_accept(i);
+        }
+    }
+
+    // Runs the I/O threads; returns at once.
+    void start() {
+        io_context_pool_.start(config_.poll_mode, config_.spin_before_block, config_.io_cpus);
+    }
+
+    // Stop accepting and turn keep-alive off. Connections close after their
+    // current response; connections() says how many are left.
+    void drain() {
+        admission_.start_draining();
+        for (size_t i = 0; i < acceptors_.size(); ++i) {
+            boost::asio::post(io_context_pool_.get_io_context(i), [this, i]() {
+                boost::system::error_code ignored;
+                acceptors_[i]->close(ignored);
+            });
+        }
+    }
+
+    // Stop the I/O threads and wait for them, then for running jobs.
+    void stop() {
+        io_context_pool_.stop();
+        io_context_pool_.join();
+        vector<JobThreads *> jobs;
+        for (auto &worker : workers_) {
+            jobs.push_back(&worker->jobs());
+        }
+        join_jobs(jobs);
+    }
+
+    vector<int> listener_fds() {
+        vector<int> fds;
+        for (auto &acceptor : acceptors_) {
+            fds.push_back(acceptor->native_handle());
+        }
+        return fds;
+    }
+
+    size_t connections() const { return admission_.connections(); }
+
+private:
+    // A new listener, or one around an inherited listening socket. Options
+    // are applied to inherited sockets too, in case they have changed.
+    unique_ptr<tcp::acceptor> make_listener(boost::asio::io_context &io_context,
+                                            const tcp::endpoint &endpoint, int inherited_fd, int cpu) {
+        using reuse_port = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+        auto acceptor = make_unique<tcp::acceptor>(io_context);
+        if (inherited_fd >= 0) {
+            acceptor->assign(endpoint.protocol(), inherited_fd);
+            socket_options::apply_listener(inherited_fd, config_.socket, cpu);
+            return acceptor;
+        }
+        acceptor->open(endpoint.protocol());
+        acceptor->set_option(tcp::acceptor::reuse_address(true));
+        if (config_.reuse_port) {
+            acceptor->set_option(reuse_port(true));
+        }
+        socket_options::apply_listener(acceptor->native_handle(), config_.socket, cpu);
+        acceptor->bind(endpoint);
+        acceptor->listen(config_.socket.backlog);
+        return acceptor;
+    }
+
+    void start_accept(size_t listener) {
+        size_t worker = config_.reuse_port ? listener : io_context_pool_.next_index();
+        acceptors_[listener]->async_accept(io_context_pool_.get_io_context(worker),
+            [this, listener, worker](boost::system::error_code ec, tcp::socket socket) {
+                // The listener's own worker runs this handler.
+                ServerWorker &accepting_worker = *workers_[listener];
+                if (!ec && !accepting_worker.admission().open_connection()) {
+                    shed_connection(socket.native_handle(), accepting_worker.date());
+                    boost::system::error_code ignored;
+                    socket.close(ignored);
+                } else if (!ec) {
+                    ServerWorker &server_worker = *workers_[worker];
+                    server_worker.stats().connections_accepted.fetch_add(1, memory_order_relaxed);
+                    if (config_.busy_poll_us > 0) {
+                        apply_busy_poll(socket.native_handle(), config_.busy_poll_us);
+                    }
+                    socket_options::apply_accepted(socket.native_handle(), config_.socket);
+                    if (config_.reuse_port) {
+                        make_shared<HTTPConnection>(std::move(socket), config_, server_worker, stats_)->start();
+                    } else {
+                        // Build the connection on its own thread so its buffers
+                        // are allocated there (and on that thread's NUMA node).
+                        boost::asio::post(server_worker.io_context(),
+                            [this, &server_worker, socket = std::move(socket)]() mutable {
+                                make_shared<HTTPConnection>(std::move(socket), config_, server_worker, stats_)->start();
+                            });
+                    }
+                } else if (ec == boost::asio::error::operation_aborted) {
+                    return;  // the listener was closed by drain()
+                } else {
+                    cerr << "Error accepting connection: " << ec.message() << endl;
+                }
+                start_accept(listener);
+            }
+        );
+    }
+
+    ServerConfig config_;
+    IoContextPool io_context_pool_;
+    ServerStats stats_;
+    AdmissionControl &admission_;
+    vector<unique_ptr<ServerWorker>> workers_;
+    vector<unique_ptr<tcp::acceptor>> acceptors_;
+};
+
+// -------------------------
+// io_uring Backend
+// -------------------------
+// Each I/O thread owns a ring, an SO_REUSEPORT listener with one multishot
+// accept, and a provided-buffer ring that all of its connections receive
+// into. Responses go out as one sendmsg; on Connection: close the close is
+// linked behind the send so both are submitted together. Submission and
+// completion reaping share one io_uring_enter per loop iteration.
+#if IO_URING_AVAILABLE
+
+class UringWorker;
+
+// The low bits of user_data say which operation completed; the rest is the
+// object it belongs to (both objects are at least 8-byte aligned).
+enum UringOp : uint64_t {
+    kUringIgnore = 0,  // linked shutdowns, cancellations
+    kUringAccept = 1,
+    kUringRecv   = 2,
+    kUringSend   = 3,
+    kUringClose  = 4,
+    kUringJobs   = 5,
+    kUringTick   = 6,  // the Date tick, or the deadline wheel's (object &wheel_tick_)
+    kUringProbe  = 7
+};
+
+inline uint64_t uring_tag(const void *object, UringOp op) {
+    return reinterpret_cast<uint64_t>(object) | op;
+}
+
+// One accepted socket. At most one receive or send (with its linked close)
+// is outstanding at a time, so the connection can be freed as soon as its
+// close completes, and a deadline that runs out only has to cancel that one
+// operation. Receives land in the worker's provided buffers and are
+// copied into a pooled ReceiveBuffer, which is handed back once the request
+// has been answered.
+class UringConnection : public RouteContext {
+public:
+    UringConnection(UringWorker &worker, int fd);
+    ~UringConnection() override;
+
+    void process_input();
+    void on_recv(const io_uring_cqe &cqe);
+    void on_send(int result);
+    // Returns true once the socket is closed and the connection can go.
+    bool on_close(int result);
+
+    void send_json_response(const json &data, int status_code) override;
+
+    void write_canned(const CannedResponse &response) override {
+        send(response_writer_.canned(response, keep_alive(), date()));
+    }
+
+    void run_job(function<JobResult()> job) override;
+    void run_coroutine(CoroutineHandler handler, const HttpRequest &request, const RouteParams &params,
+                       string_view body) override;
+
+    void close_after_response() override {
+        keep_alive_ = false;
+    }
+
+    const ServerStats &server_stats() const override;
+    const ServerConfig &server_config() const override;
+
+private:
+    static void on_deadline(void *connection);
+    bool keep_alive();
+    const DateCache &date() const;
+    void submit_recv();
+    void send(const ResponseWriter::Buffers &buffers);
+    void submit_send();
+    void submit_close();
+    void submit_drain();
+    void finish_request();
+
+    UringWorker &worker_;
+    int fd_;
+    ConnectionDeadline deadline_;
+    ReceiveBuffer input_;
+    size_t request_size_ = 0;  // of the request being served, once its head is parsed
+    bool keep_alive_ = false;
+    bool close_linked_ = false;
+    bool draining_ = false;    // a request was refused; linger before closing
+    bool timed_out_ = false;   // a deadline ran out; close on the next completion
+    bool admitted_ = false;    // the request being served holds an in-flight slot
+    ResponseWriter response_writer_;
+    string body_;
+    shared_ptr<CoroutineRunner> coroutine_runner_;  // made for the first coroutine request
+    iovec iov_[4];
+    msghdr msg_{};
+};
+
+class UringWorker {
+public:
+    static constexpr unsigned kRingEntries = 4096;
+    static constexpr unsigned kReceiveBuffers = 512;
+    static constexpr size_t kReceiveBufferSize = 4096;
+
+    // listen_fd is an inherited listening socket, or -1 to open one; cpu is
+    // the listener's SO_INCOMING_CPU, or -1.
+    UringWorker(const ServerConfig &config, WorkerStats &stats, const ServerStats &server_stats,
+                AdmissionControl &admission, int listen_fd, int cpu)
+        : config_(config), stats_(stats), server_stats_(server_stats),
+          scratch_(stats.receive_buffers, config.huge_pages), deadlines_(config, stats),
+          admission_(admission, config, stats), ring_(kRingEntries),
+          receive_memory_(huge_pages::map(kReceiveBuffers * kReceiveBufferSize, config.huge_pages,
+                                          &stats.receive_buffers.mappings)),
+          buffers_(ring_, 0, kReceiveBuffers, kReceiveBufferSize, receive_memory_.data()) {
+        if (listen_fd >= 0) {
+            socket_options::apply_listener(listen_fd, config.socket, cpu);
+            listen_fd_ = listen_fd;
+        } else {
+            listen_fd_ = open_reuseport_listener(config.port, config.socket, cpu);
+        }
+        jobs_fd_ = eventfd(0, EFD_CLOEXEC);
+        if (jobs_fd_ < 0) {
+            close(listen_fd_);
+            throw uring::errno_error("eventfd");
+        }
+        tick_.tv_sec = 1;
+        wheel_tick_.tv_nsec = duration_cast<nanoseconds>(TimingWheel::kTick).count();
+    }
+
+    ~UringWorker() {
+        if (listen_fd_ >= 0) {
+            close(listen_fd_);
+        }
+        close(jobs_fd_);
+    }
+
+    UringWorker(const UringWorker &) = delete;
+    UringWorker &operator=(const UringWorker &) = delete;
+
+    // In the spinning modes the completion queue is polled from user space;
+    // submit() only enters the kernel when there are new SQEs to hand over.
+    void run() {
+        t_allocation_counter = &stats_.allocations;
+        thread coroutine_thread([this]() { coroutine_context_.run(); });
+        submit_accept();
+        submit_jobs_wakeup();
+        submit_tick();
+        if (config_.wakeup_probe_interval.count() > 0) {
+            submit_probe();
+        }
+        const auto mode = config_.poll_mode;
+        auto idle_since = steady_clock::now();
+        while (!stop_requested_.load(memory_order_relaxed)) {
+            bool block = mode == ServerConfig::PollMode::block ||
+                         (mode == ServerConfig::PollMode::hybrid &&
+                          steady_clock::now() - idle_since >= config_.spin_before_block);
+            ring_.submit(block ? 1 : 0);
+            unsigned completed = ring_.for_each_cqe([this](const io_uring_cqe &cqe) { handle_completion(cqe); });
+            if (completed > 0 && mode == ServerConfig::PollMode::hybrid) {
+                idle_since = steady_clock::now();
+            }
+            stats_.io_syscalls.store(ring_.enter_calls(), memory_order_relaxed);
+        }
+        coroutine_context_.stop();
+        coroutine_thread.join();
+    }
+
+    // Called from a job thread: hand the result to the ring's thread.
+    void post_job_result(UringConnection *connection, JobResult result) {
+        {
+            lock_guard<mutex> lock(jobs_mutex_);
+            finished_jobs_.emplace_back(connection, std::move(result));
+        }
+        wake();
+    }
+
+    // Called from another thread: stop accepting (the listener is closed
+    // once its accept is cancelled), or leave run().
+    void drain() {
+        drain_requested_.store(true, memory_order_relaxed);
+        wake();
+    }
+
+    void stop() {
+        stop_requested_.store(true, memory_order_relaxed);
+        wake();
+    }
+
+    int listen_fd() const { return listen_fd_; }
+
+    // Where this worker's connections run coroutine handlers: an io_context
+    // on a thread of its own, shared by all of them.
+    boost::asio::io_context::executor_type coroutine_executor() { return coroutine_context_.get_executor(); }
+
+    uring::Ring &ring() { return ring_; }
+    uring::BufferRing &buffers() { return buffers_; }
+    RequestScratch &scratch() { return scratch_; }
+    const DateCache &date() const { return date_; }
+    WorkerStats &stats() { return stats_; }
+    DeadlineWheel &deadlines() { return deadlines_; }
+    WorkerAdmission &admission() { return admission_; }
+    JobThreads &jobs() { return jobs_; }
+
+    void set_deadline(ConnectionDeadline &deadline, Deadline phase) {
+        deadlines_.enter(deadline, phase);
+        if (phase != Deadline::none && !wheel_ticking_) {
+            wheel_ticking_ = true;
+            submit_wheel_tick();
+        }
+    }
+    const ServerStats &server_stats() const { return server_stats_; }
+    const ServerConfig &config() const { return config_; }
+
+private:
+    // Completes the read on jobs_fd_, which brings the loop round to look at
+    // finished jobs and at drain and stop requests.
+    void wake() {
+        uint64_t one = 1;
+        ssize_t ignored = write(jobs_fd_, &one, sizeof(one));
+        (void)ignored;
+    }
+
+    void submit_accept() {
+        uring::prep_multishot_accept(ring_.get_sqe(), listen_fd_, uring_tag(this, kUringAccept));
+    }
+
+    void submit_jobs_wakeup() {
+        uring::prep_read(ring_.get_sqe(), jobs_fd_, &jobs_counter_, sizeof(jobs_counter_),
+                         uring_tag(this, kUringJobs));
+    }
+
+    // Wakes the loop once a second to refresh the Date line.
+    void submit_tick() {
+        uring::prep_timeout(ring_.get_sqe(), &tick_, uring_tag(this, kUringTick));
+    }
+
+    // Advances the deadline wheel every tick while it has deadlines armed.
+    // How late it completes is the queue delay sample for admission control.
+    void submit_wheel_tick() {
+        wheel_tick_due_ = steady_clock::now() + TimingWheel::kTick;
+        uring::prep_timeout(ring_.get_sqe(), &wheel_tick_, uring_tag(&wheel_tick_, kUringTick));
+    }
+
+    // Samples wake-up latency: how long after its deadline the timeout's
+    // completion is handled.
+    void submit_probe() {
+        auto interval = duration_cast<nanoseconds>(config_.wakeup_probe_interval);
+        probe_timeout_.tv_sec = interval.count() / 1000000000;
+        probe_timeout_.tv_nsec = interval.count() % 1000000000;
+        probe_deadline_ = steady_clock::now() + interval;
+        uring::prep_timeout(ring_.get_sqe(), &probe_timeout_, uring_tag(this, kUringProbe));
+    }
+
+    void handle_completion(const io_uring_cqe &cqe) {
+        auto op = static_cast<UringOp>(cqe.user_data & 7);
+        void *object = reinterpret_cast<void *>(cqe.user_data & ~uint64_t(7));
+        switch (op) {
+        case kUringIgnore:
+            return;
+        case kUringAccept:
+            if (cqe.res >= 0 && !admission_.open_connection()) {
+                shed_connection(cqe.res, date_);
+                close(cqe.res);
+            } else if (cqe.res >= 0) {
+                stats_.connections_accepted.fetch_add(1, memory_order_relaxed);
+                if (config_.busy_poll_us > 0) {
+                    apply_busy_poll(cqe.res, config_.busy_poll_us);
+                }
+                socket_options::apply_accepted(cqe.res, config_.socket);
+                (new UringConnection(*this, cqe.res))->process_input();
+            } else if (cqe.res == -EINVAL || cqe.res == -EBADF || cqe.res == -ENOTSOCK || cqe.res == -EFAULT) {
+                // The accept itself is wrong, not the connection: submitting
+                // it again would fail the same way in a loop and never take
+                // a connection, so the process gives up.
+                cerr << "Accept on the listener failed: " << strerror(-cqe.res) << "; exiting" << endl;
+                cerr.flush();
+                _exit(EXIT_FAILURE);
+            } else if (cqe.res != -EAGAIN && cqe.res != -ECONNABORTED && cqe.res != -ECANCELED) {
+                cerr << "Error accepting connection: " << strerror(-cqe.res) << endl;
+            }
+            if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                if (accepting_) {
+                    submit_accept();
+                } else {
+                    close(listen_fd_);
+                    listen_fd_ = -1;
+                }
+            }
+            return;
+        case kUringRecv:
+            static_cast<UringConnection *>(object)->on_recv(cqe);
+            return;
+        case kUringSend:
+            static_cast<UringConnection *>(object)->on_send(cqe.res);
+            return;
+        case kUringClose: {
+            auto *connection = static_cast<UringConnection *>(object);
+            if (connection->on_close(cqe.res)) {
+                delete connection;
+            }
+            return;
+        }
+        case kUringJobs:
+            deliver_job_results();
+            if (accepting_ && drain_requested_.load(memory_order_relaxed)) {
+                accepting_ = false;
+                uring::prep_cancel(ring_.get_sqe(), uring_tag(this, kUringAccept), uring_tag(this, kUringIgnore));
+            }
+            submit_jobs_wakeup();
+            return;
+        case kUringTick:
+            if (object == &wheel_tick_) {
+                auto now = steady_clock::now();
+                admission_.record_queue_delay(now, now - wheel_tick_due_);
+                wheel_ticking_ = deadlines_.tick();
+                if (wheel_ticking_) {
+                    submit_wheel_tick();
+                } else {
+                    admission_.stop_sampling();
+                }
+                return;
+            }
+            date_.refresh();
+            submit_tick();
+            return;
+        case kUringProbe: {
+            auto late = steady_clock::now() - probe_deadline_;
+            int64_t late_ns = duration_cast<nanoseconds>(late).count();
+            stats_.wakeup_latency.record(static_cast<uint64_t>(max<int64_t>(0, late_ns)));
+            submit_probe();
+            return;
+        }
+        }
+    }
+
+    void deliver_job_results();
+
+    const ServerConfig &config_;
+    WorkerStats &stats_;
+    const ServerStats &server_stats_;
+    RequestScratch scratch_;
+    DeadlineWheel deadlines_;
+    WorkerAdmission admission_;
+    uring::Ring ring_;
+    huge_pages::Mapping receive_memory_;  // the provided buffers
+    uring::BufferRing buffers_;
+    DateCache date_;
+    int listen_fd_ = -1;
+    int jobs_fd_ = -1;
+    uint64_t jobs_counter_ = 0;
+    bool accepting_ = true;
+    atomic<bool> drain_requested_{false};
+    atomic<bool> stop_requested_{false};
+    __kernel_timespec tick_{};
+    __kernel_timespec wheel_tick_{};
+    steady_clock::time_point wheel_tick_due_;
+    bool wheel_ticking_ = false;
+    __kernel_timespec probe_timeout_{};
+    steady_clock::time_point probe_deadline_;
+    mutex jobs_mutex_;
+    vector<pair<UringConnection *, JobResult>> finished_jobs_;
+    boost::asio::io_context coroutine_context_{1};
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> coroutine_work_{
+        coroutine_context_.get_executor()};
+    JobThreads jobs_;  // last, so it is joined before the rest goes away
+};
+
+inline void UringWorker::deliver_job_results() {
+    vector<pair<UringConnection *, JobResult>> finished;
+    {
+        lock_guard<mutex> lock(jobs_mutex_);
+        finished.swap(finished_jobs_);
+    }
+    for (auto &job : finished) {
+        send_result(*job.first, job.second);
+    }
+}
+
+inline UringConnection::UringConnection(UringWorker &worker, int fd)
+    : worker_(worker), fd_(fd), deadline_(&UringConnection::on_deadline, this), input_(worker.scratch().buffers) {}
+
+// The connection was admitted by the worker's accept handler.
+inline UringConnection::~UringConnection() {
+    if (admitted_) {
+        worker_.admission().finish_request();
+    }
+    worker_.admission().close_connection();
+    worker_.scratch().release(this);
+    if (coroutine_runner_) {
+        boost::asio::post(worker_.coroutine_executor(), [runner = std::move(coroutine_runner_)]() { runner->stop(); });
+    }
+}
+
+inline void UringConnection::send_json_response(const json &data, int status_code) {
+    worker_.scratch().serialize(data, body_);
+    send(response_writer_.build(status_code, http_headers::kJson, body_, keep_alive(), date()));
+}
+
+// Decided when the response goes out, as in the asio backend.
+inline bool UringConnection::keep_alive() {
+    keep_alive_ = keep_alive_ && !worker_.admission().draining();
+    return keep_alive_;
+}
+
+inline const DateCache &UringConnection::date() const {
+    return worker_.date();
+}
+
+inline const ServerStats &UringConnection::server_stats() const {
+    return worker_.server_stats();
+}
+
+inline const ServerConfig &UringConnection::server_config() const {
+    return worker_.config();
+}
+
+// The connection stays alive while the job runs: nothing else is in flight
+// for it, so no completion can close it underneath the job. The worker
+// joins the job's thread before it goes away.
+inline void UringConnection::run_job(function<JobResult()> job) {
+    UringWorker *worker = &worker_;
+    worker->jobs().start([this, worker, job = std::move(job)]() {
+        worker->post_job_result(this, job());
+    });
+}
+
+// The ring is not an asio executor, so coroutines run on the worker's
+// coroutine thread and their results come back the way a job's do. The
+// request is copied here: the runner is idle until the post arrives.
+inline void UringConnection::run_coroutine(CoroutineHandler handler, const HttpRequest &request,
+                                           const RouteParams &params, string_view body) {
+    if (!coroutine_runner_) {
+        UringWorker *worker = &worker_;
+        coroutine_runner_ = make_shared<CoroutineRunner>(worker_.coroutine_executor(), worker_.config(),
+            [this, worker](JobResult result) { worker->post_job_result(this, std::move(result)); });
+    }
+    coroutine_runner_->request().assign(request, params, body);
+    boost::asio::post(worker_.coroutine_executor(), [runner = coroutine_runner_.get(), handler]() {
+        runner->run(handler);
+    });
+}
+
+// Serve the buffered request if it is complete; receive more if not.
+inline void UringConnection::process_input() {
+    RequestScratch &scratch = worker_.scratch();
+    Framing framing = scratch.frame_request(this, input_, request_size_, worker_.config());
+    if (framing == Framing::need_more) {
+        worker_.set_deadline(deadline_, receive_phase(input_, request_size_));
+        submit_recv();
+        return;
+    }
+    if (framing != Framing::ready) {
+        keep_alive_ = false;
+        draining_ = true;
+        write_canned(framing_error_response(framing));
+        return;
+    }
+    worker_.set_deadline(deadline_, Deadline::none);
+    keep_alive_ = scratch.parser.request().keep_alive;
+    if (!worker_.admission().admit_request()) {
+        scratch.finish_request();
+        write_canned(kServiceUnavailableResponse);
+        return;
+    }
+    admitted_ = true;
+    worker_.stats().requests_served.fetch_add(1, memory_order_relaxed);
+    dispatch_framed_request(*this, scratch, input_);
+}
+
+// A deadline ran out: cancel the receive or send in flight. Its completion,
+// failed or not, then closes the connection; a linked close the
+// cancellation takes down with it is reissued by on_close().
+inline void UringConnection::on_deadline(void *connection) {
+    auto *self = static_cast<UringConnection *>(connection);
+    self->timed_out_ = true;
+    UringOp op = self->worker_.deadlines().expired(self->deadline_) == Deadline::write ? kUringSend : kUringRecv;
+    uring::prep_cancel(self->worker_.ring().get_sqe(), uring_tag(self, op), uring_tag(self, kUringIgnore));
+}
+
+inline void UringConnection::submit_recv() {
+    uring::prep_recv_select(worker_.ring().get_sqe(), fd_, worker_.buffers().group_id(),
+                            static_cast<unsigned>(worker_.buffers().buffer_size()), uring_tag(this, kUringRecv));
+}
+
+inline void UringConnection::on_recv(const io_uring_cqe &cqe) {
+    if (cqe.res == -ENOBUFS && !timed_out_) {
+        // Every receive buffer is in use; try again on the next loop pass.
+        submit_recv();
+        return;
+    }
+    if (cqe.res <= 0 || timed_out_) {
+        // Peer closed, error, or a deadline ran out (the receive may have
+        // completed before the cancellation reached it).
+        if (cqe.res > 0) {
+            worker_.buffers().recycle(uring::cqe_buffer_id(cqe));
+        }
+        submit_close();
+        return;
+    }
+    uint16_t buffer_id = uring::cqe_buffer_id(cqe);
+    if (draining_) {
+        worker_.buffers().recycle(buffer_id);
+        submit_recv();
+        return;
+    }
+    input_.append(worker_.buffers().buffer(buffer_id), static_cast<size_t>(cqe.res));
+    worker_.buffers().recycle(buffer_id);
+    process_input();
+}
+
+inline void UringConnection::send(const ResponseWriter::Buffers &buffers) {
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        iov_[i].iov_base = const_cast<void *>(buffers[i].data());
+        iov_[i].iov_len = buffers[i].size();
+    }
+    msg_ = msghdr{};
+    msg_.msg_iov = iov_;
+    msg_.msg_iovlen = buffers.size();
+    worker_.set_deadline(deadline_, Deadline::write);
+    submit_send();
+}
+
+inline void UringConnection::submit_send() {
+    io_uring_sqe *sqe = worker_.ring().get_sqe();
+    uring::prep_sendmsg(sqe, fd_, &msg_, MSG_NOSIGNAL | MSG_WAITALL, uring_tag(this, kUringSend));
+    if (!keep_alive_ && !draining_) {
+        sqe->flags |= IOSQE_IO_LINK;
+        close_linked_ = true;
+        uring::prep_close(worker_.ring().get_sqe(), fd_, uring_tag(this, kUringClose));
+    }
+}
+
+inline void UringConnection::on_send(int result) {
+    if (close_linked_) {
+        // The linked close completes next and decides what happens.
+        return;
+    }
+    if (result < 0 || timed_out_) {
+        submit_close();
+        return;
+    }
+    // Resume a short write from where it stopped.
+    size_t sent = static_cast<size_t>(result);
+    while (msg_.msg_iovlen > 0 && sent >= msg_.msg_iov[0].iov_len) {
+        sent -= msg_.msg_iov[0].iov_len;
+        ++msg_.msg_iov;
+        --msg_.msg_iovlen;
+    }
+    if (msg_.msg_iovlen > 0) {
+        msg_.msg_iov[0].iov_base = static_cast<char *>(msg_.msg_iov[0].iov_base) + sent;
+        msg_.msg_iov[0].iov_len -= sent;
+        submit_send();
+        return;
+    }
+    finish_request();
+    if (draining_) {
+        submit_drain();
+        return;
+    }
+    process_input();
+}
+
+// After refusing a request the client may still be sending it; closing with
+// unread data would reset the connection, possibly before the client has
+// read the response. So shut down the sending side and discard input until
+// the client closes or the idle deadline passes.
+inline void UringConnection::submit_drain() {
+    input_.release();
+    worker_.set_deadline(deadline_, Deadline::idle);
+    io_uring_sqe *sqe = worker_.ring().get_sqe();
+    uring::prep_shutdown(sqe, fd_, SHUT_WR, uring_tag(this, kUringIgnore));
+    sqe->flags |= IOSQE_IO_LINK;
+    submit_recv();
+}
+
+inline void UringConnection::submit_close() {
+    worker_.set_deadline(deadline_, Deadline::none);
+    close_linked_ = true;
+    uring::prep_close(worker_.ring().get_sqe(), fd_, uring_tag(this, kUringClose));
+}
+
+// A close linked behind a failed send is cancelled; issue it on its own.
+inline bool UringConnection::on_close(int result) {
+    if (result == -ECANCELED) {
+        submit_close();
+        return false;
+    }
+    return true;
+}
+
+// Drop the request that was just answered from the buffer, and give back
+// its in-flight slot.
+inline void UringConnection::finish_request() {
+    input_.consume(request_size_);
+    request_size_ = 0;
+    if (admitted_) {
+        admitted_ = false;
+        worker_.admission().finish_request();
+    }
+}
+
+class UringServer {
+public:
+    explicit UringServer(const ServerConfig &config)
+        : config_(config), stats_(config, max<size_t>(1, config.num_threads)),
+          admission_(stats_.admission()) {
+        server_routes();
+        vector<int> inherited = take_inherited_listeners(config_, stats_.size());
+        for (size_t i = 0; i < stats_.size(); ++i) {
+            // The ring and receive buffers are first touched on the worker's CPU.
+            auto make_worker = [&]() {
+                workers_.push_back(make_unique<UringWorker>(config_, stats_.worker(i), stats_, admission_,
+                                                            inherited.empty() ? -1 : inherited[i],
+                                                            listener_cpu(config_, i)));
+            };
+            if (config_.io_cpus.empty()) {
+                make_worker();
+            } else {
+                cpu_affinity::run_on_cpu(config_.io_cpus[i % config_.io_cpus.size()], make_worker);
+            }
+        }
+        cout << "Server listening on port " << config.port
+             << " with " << workers_.size() << " io_uring threads, "
+             << poll_mode_name(config.poll_mode) << " polling"
+             << (inherited.empty() ? "" : " (listeners inherited)") << endl;
+        cout << "Socket options: " << socket_options::describe(listener_fds(), config.socket) << endl;
+        print_placement(config);
+        print_huge_pages(config);
+        print_admission(config);
+    }
+
+    static bool supported() {
+        return uring::kernel_supported();
+    }
+
+    // Runs every worker on its own thread; returns at once.
+    void start() {
+        for (size_t i = 0; i < workers_.size(); ++i) {
+            auto &worker = workers_[i];
+            int cpu = config_.io_cpus.empty() ? -1 : config_.io_cpus[i % config_.io_cpus.size()];
+            threads_.emplace_back([&worker, cpu]() {
+                if (cpu >= 0 && !cpu_affinity::pin_current_thread(cpu)) {
+                    cerr << "Could not pin I/O thread to CPU " << cpu << endl;
+                }
+                worker->run();
+            });
+        }
+    }
+
+    // Same contract as HTTPServer::drain().
+    void drain() {
+        admission_.start_draining();
+        for (auto &worker : workers_) {
+            worker->drain();
+        }
+    }
+
+    void stop() {
+        for (auto &worker : workers_) {
+            worker->stop();
+        }
+        for (auto &t : threads_) {
+            t.join();
+        }
+        threads_.clear();
+        vector<JobThreads *> jobs;
+        for (auto &worker : workers_) {
+            jobs.push_back(&worker->jobs());
+        }
+        join_jobs(jobs);
+    }
+
+    vector<int> listener_fds() {
+        vector<int> fds;
+        for (auto &worker : workers_) {
+            fds.push_back(worker->listen_fd());
+        }
+        return fds;
+    }
+
+    size_t connections() const { return admission_.connections(); }
+
+private:
+    ServerConfig config_;
+    ServerStats stats_;
+    AdmissionControl &admission_;
+    vector<unique_ptr<UringWorker>> workers_;
+    vector<thread> threads_;
+};
+
+#endif // IO_URING_AVAILABLE
+
+// -------------------------
+// Command Line
+// -------------------------
+ServerConfig parse_args(int argc, char *argv[]) {
+    ServerConfig config;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        auto next_value = [&]() -> string {
+            if (i + 1 >= argc) {
+                throw runtime_error("Missing value for " + arg);
+            }
+            return argv[++i];
+        };
+        if (arg == "--port") {
+            config.port = static_cast<unsigned short>(stoul(next_value()));
+        } else if (arg == "--threads") {
+            config.num_threads = stoul(next_value());
+        } else if (arg == "--keep-alive-timeout-ms") {
+            config.keep_alive_timeout = milliseconds(stoul(next_value()));
+        } else if (arg == "--header-timeout-ms") {
+            config.header_timeout = milliseconds(stoul(next_value()));
+        } else if (arg == "--body-timeout-ms") {
+            config.body_timeout = milliseconds(stoul(next_value()));
+        } else if (arg == "--write-timeout-ms") {
+            config.write_timeout = milliseconds(stoul(next_value()));
+        } else if (arg == "--max-connections") {
+            config.max_connections = stoul(next_value());
+        } else if (arg == "--max-in-flight") {
+            config.max_in_flight = stoul(next_value());
+        } else if (arg == "--shed-target-ms") {
+            config.shed_target = milliseconds(stoul(next_value()));
+        } else if (arg == "--shed-interval-ms") {
+            config.shed_interval = milliseconds(stoul(next_value()));
+        } else if (arg == "--processes") {
+            config.processes = stoul(next_value());
+        } else if (arg == "--drain-timeout-ms") {
+            config.drain_timeout = milliseconds(stoul(next_value()));
+        } else if (arg == "--upgrade-fd") {
+            config.upgrade_fd = stoi(next_value());
+        } else if (arg == "--max-header-bytes") {
+            config.max_header_size = stoul(next_value());
+        } else if (arg == "--max-body-bytes") {
+            config.max_body_size = stoul(next_value());
+        } else if (arg == "--reuse-port") {
+            config.reuse_port = true;
+        } else if (arg == "--poll-mode") {
+            string mode = next_value();
+            if (mode == "block") {
+                config.poll_mode = ServerConfig::PollMode::block;
+            } else if (mode == "spin") {
+                config.poll_mode = ServerConfig::PollMode::spin;
+            } else if (mode == "hybrid") {
+                config.poll_mode = ServerConfig::PollMode::hybrid;
+            } else {
+                throw runtime_error("Unknown poll mode: " + mode);
+            }
+        } else if (arg == "--spin-us") {
+            config.spin_before_block = microseconds(stoul(next_value()));
+        } else if (arg == "--busy-poll-us") {
+            config.busy_poll_us = stoi(next_value());
+        } else if (arg == "--socket-profile") {
+            config.socket = socket_options::profile(next_value());
+        } else if (arg == "--tcp-nodelay") {
+            config.socket.no_delay = socket_options::parse_switch(next_value());
+        } else if (arg == "--tcp-quickack") {
+            config.socket.quick_ack = socket_options::parse_switch(next_value());
+        } else if (arg == "--defer-accept-s") {
+            config.socket.defer_accept_s = stoi(next_value());
+        } else if (arg == "--fastopen-queue") {
+            config.socket.fastopen_queue = stoi(next_value());
+        } else if (arg == "--rcvbuf") {
+            config.socket.receive_buffer = stoi(next_value());
+        } else if (arg == "--sndbuf") {
+            config.socket.send_buffer = stoi(next_value());
+        } else if (arg == "--backlog") {
+            config.socket.backlog = stoi(next_value());
+        } else if (arg == "--incoming-cpu") {
+            config.socket.incoming_cpu = socket_options::parse_switch(next_value());
+        } else if (arg == "--wakeup-probe-us") {
+            config.wakeup_probe_interval = microseconds(stoul(next_value()));
+        } else if (arg == "--cpus") {
+            config.io_cpus = cpu_affinity::parse_cpu_list(next_value());
+        } else if (arg == "--huge-pages") {
+            config.huge_pages = huge_pages::parse_mode(next_value());
+        } else if (arg == "--benchmark-cpus") {
+            config.benchmark_cpus = cpu_affinity::parse_cpu_list(next_value());
+        } else if (arg == "--backend") {
+            string backend = next_value();
+            if (backend == "asio") {
+                config.backend = ServerConfig::Backend::asio;
+            } else if (backend == "io_uring") {
+                config.backend = ServerConfig::Backend::io_uring;
+            } else {
+                throw runtime_error("Unknown backend: " + backend);
+            }
+        } else {
+            throw runtime_error("Unknown argument: " + arg);
+        }
+    }
+    return config;
+}
+
+// -------------------------
+// Shutdown and Hot Upgrade
+// -------------------------
+// The server runs on its own threads while the main thread waits for a
+// signal. SIGTERM or SIGINT drains and exits: listeners close, connections
+// close after their current response, and the process waits up to
+// drain_timeout for the last one to go, including any whose benchmark job
+// is still running; a second signal cuts the wait short. SIGUSR2 first
+// starts a new server on the same listening sockets and drains only once it
+// is accepting, so no connection attempt is refused during an upgrade.
+sigset_t shutdown_signals() {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGUSR2);
+    return signals;
+}
+
+constexpr milliseconds kUpgradeTimeout{10000};
+
+// args is the command line to start a new server with.
+template <typename Server>
+[[noreturn]] void serve(Server &server, const ServerConfig &config, const vector<string> &args) {
+    sigset_t signals = shutdown_signals();
+    server.start();
+    if (config.upgrade_fd >= 0) {
+        handoff::announce_ready(config.upgrade_fd);
+    }
+    for (;;) {
+        int signal = 0;
+        sigwait(&signals, &signal);
+        if (signal != SIGUSR2) {
+            cout << "Draining connections" << endl;
+            break;
+        }
+        if (config.prefork) {
+            continue;  // the master upgrades the whole group
+        }
+        pid_t successor = -1;
+        try {
+            successor = handoff::start_successor(args, server.listener_fds(), kUpgradeTimeout);
+        } catch (const system_error &e) {
+            cerr << "Upgrade failed: " << e.what() << endl;
+        }
+        if (successor > 0) {
+            cout << "Listeners handed to pid " << successor << ", draining connections" << endl;
+            break;
+        }
+        cerr << "Upgrade failed: the new server did not start; still serving" << endl;
+    }
+    server.drain();
+    auto deadline = steady_clock::now() + config.drain_timeout;
+    while (server.connections() > 0 && steady_clock::now() < deadline) {
+        timespec wait = {0, 10000000};
+        int signal = sigtimedwait(&signals, nullptr, &wait);
+        if (signal == SIGTERM || signal == SIGINT) {
+            break;
+        }
+    }
+    if (size_t remaining = server.connections(); remaining > 0) {
+        cerr << "Closing " << remaining << " connections still open after draining" << endl;
+    }
+    server.stop();
+    cout << "Server stopped" << endl;
+    // Exit without unwinding: handlers still queued on the stopped event
+    // loops refer to their workers, and nothing is left to flush or release.
+    cerr.flush();
+    _exit(0);
+}
+
+// Build the configured server and serve until shutdown.
+[[noreturn]] void run_server(const ServerConfig &config, const vector<string> &args) {
+    if (config.backend == ServerConfig::Backend::io_uring) {
+#if IO_URING_AVAILABLE
+        if (UringServer::supported()) {
+            UringServer server(config);
+            serve(server, config, args);
+        }
+#endif
+        if (!config.prefork || config.process_index == 0) {
+            cerr << "io_uring is not available here, falling back to the asio backend" << endl;
+        }
+    }
+    HTTPServer server(config);
+    serve(server, config, args);
+}
+
+// -------------------------
+// Prefork Mode
+// -------------------------
+// nginx-style: the master opens every listener with SO_REUSEPORT, so the
+// kernel spreads connections over all of them, maps the shared stats
+// segment and forks the worker processes. Each worker serves its own share
+// of the listeners with its own threads, heap and event loops, so a crash
+// or allocator contention stays within one process. A worker that dies is
+// replaced on the same listeners and none of their queued connections are
+// lost; one that dies within a second of starting is left dead rather than
+// restarted in a loop. SIGTERM and SIGINT are passed on to the workers,
+// which drain as a single server would; SIGUSR2 first hands every listener
+// to a new master. The master serves no requests itself; on exit it reports
+// the totals of all workers.
+
+// How many listeners one process's server uses.
+size_t listeners_per_process(const ServerConfig &config) {
+    bool uring = false;
+#if IO_URING_AVAILABLE
+    uring = config.backend == ServerConfig::Backend::io_uring && UringServer::supported();
+#endif
+    return uring || config.reuse_port ? max<size_t>(1, config.num_threads) : 1;
+}
+
+constexpr seconds kMinWorkerLifetime{1};
+
+int run_prefork(ServerConfig config, const vector<string> &args) {
+    size_t per_process = listeners_per_process(config);
+    vector<int> listeners = take_inherited_listeners(config, per_process * config.processes);
+    bool inherited = !listeners.empty();
+    // Listener i belongs to I/O thread i % per_process of its process.
+    bool per_thread = per_process == max<size_t>(1, config.num_threads);
+    while (listeners.size() < per_process * config.processes) {
+        int cpu = per_thread ? listener_cpu(config, listeners.size() % per_process) : -1;
+        listeners.push_back(open_reuseport_listener(config.port, config.socket, cpu));
+    }
+    PreforkSegment segment(config.processes, max<size_t>(1, config.num_threads), config);
+    cout << "Prefork master " << getpid() << ": " << config.processes << " worker processes x "
+         << segment.threads() << " I/O threads on port " << config.port
+         << (inherited ? " (listeners inherited)" : "") << endl;
+    // The listeners are open, so no connection is refused from here on.
+    if (config.upgrade_fd >= 0) {
+        handoff::announce_ready(config.upgrade_fd);
+        config.upgrade_fd = -1;
+    }
+
+    sigset_t signals = shutdown_signals();
+    sigaddset(&signals, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    const pid_t master = getpid();
+    vector<pid_t> workers(config.processes, -1);
+    vector<steady_clock::time_point> started(config.processes);
+    auto spawn = [&](size_t process) {
+        segment.reset(process);
+        pid_t pid = fork();
+        if (pid < 0) {
+            cerr << "Could not start worker " << process << ": " << strerror(errno) << endl;
+            return;
+        }
+        if (pid == 0) {
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            if (getppid() != master) {
+                _exit(0);
+            }
+            ServerConfig worker_config = config;
+            worker_config.processes = 0;
+            worker_config.prefork = &segment;
+            worker_config.process_index = process;
+            for (size_t i = 0; i < listeners.size(); ++i) {
+                if (i / per_process == process) {
+                    worker_config.inherited_listeners.push_back(listeners[i]);
+                } else {
+                    close(listeners[i]);
+                }
+            }
+            segment.set_pid(process, getpid());
+            try {
+                run_server(worker_config, args);
+            } catch (exception &e) {
+                cerr << "Worker exception: " << e.what() << endl;
+            }
+            _exit(1);
+        }
+        workers[process] = pid;
+        started[process] = steady_clock::now();
+    };
+    for (size_t p = 0; p < workers.size(); ++p) {
+        spawn(p);
+    }
+
+    bool stopping = false;
+    bool failed = false;
+    size_t restarts = 0;
+    while (any_of(workers.begin(), workers.end(), [](pid_t pid) { return pid > 0; })) {
+        int signal = 0;
+        sigwait(&signals, &signal);
+        if (signal == SIGCHLD) {
+            int status = 0;
+            pid_t pid;
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+                auto it = find(workers.begin(), workers.end(), pid);
+                if (it == workers.end()) {
+                    continue;  // a successor started by an upgrade
+                }
+                size_t process = static_cast<size_t>(it - workers.begin());
+                *it = -1;
+                if (stopping) {
+                    continue;
+                }
+                cerr << "Worker " << pid << " exited ("
+                     << (WIFSIGNALED(status) ? "signal " + to_string(WTERMSIG(status))
+                                             : "status " + to_string(WEXITSTATUS(status))) << ")";
+                if (steady_clock::now() - started[process] < kMinWorkerLifetime) {
+                    // Close its listeners too, or the kernel would keep
+                    // queueing connections on them for nobody to accept.
+                    cerr << " right after starting; not restarting it" << endl;
+                    for (size_t i = process * per_process; i < (process + 1) * per_process; ++i) {
+                        close(listeners[i]);
+                        listeners[i] = -1;
+                    }
+                    segment.set_pid(process, 0);
+                    failed = true;
+                    continue;
+                }
+                cerr << "; restarting it" << endl;
+                ++restarts;
+                spawn(process);
+            }
+            continue;
+        }
+        if (signal == SIGUSR2) {
+            if (stopping) {
+                continue;
+            }
+            pid_t successor = -1;
+            try {
+                vector<int> open_listeners;
+                copy_if(listeners.begin(), listeners.end(), back_inserter(open_listeners),
+                        [](int fd) { return fd >= 0; });
+                successor = handoff::start_successor(args, open_listeners, kUpgradeTimeout);
+            } catch (const system_error &e) {
+                cerr << "Upgrade failed: " << e.what() << endl;
+            }
+            if (successor < 0) {
+                cerr << "Upgrade failed: the new master did not start; still serving" << endl;
+                continue;
+            }
+            cout << "Listeners handed to pid " << successor << ", draining workers" << endl;
+        }
+        // Shutting down, or handed over. Another signal is passed on too and
+        // cuts the workers' drain short.
+        stopping = true;
+        for (pid_t pid : workers) {
+            if (pid > 0) {
+                kill(pid, SIGTERM);
+            }
+        }
+    }
+    for (int fd : listeners) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    ServerConfig totals_config = config;
+    totals_config.prefork = &segment;
+    json totals = ServerStats(totals_config, segment.threads()).snapshot();
+    cout << "Prefork master stopped: workers served " << totals["requests_served"] << " requests on "
+         << totals["connections_accepted"] << " connections, " << restarts << " restarts" << endl;
+    return failed && !stopping ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    // Blocked before any thread starts, so every thread inherits the mask
+    // and only serve() sees these signals.
+    sigset_t signals = shutdown_signals();
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    try {
+        ServerConfig config = parse_args(argc, argv);
+        vector<string> args;
+        for (int i = 0; i < argc; ++i) {
+            if (string(argv[i]) == "--upgrade-fd") {
+                ++i;
+                continue;
+            }
+            args.push_back(argv[i]);
+        }
+        if (config.upgrade_fd >= 0) {
+            config.inherited_listeners = handoff::receive_fds(config.upgrade_fd);
+        }
+        if (config.processes > 0) {
+            return run_prefork(config, args);
+        }
+        run_server(config, args);
     } catch (exception &e) {
         cerr << "Server exception: " << e.what() << endl;
         return 1;
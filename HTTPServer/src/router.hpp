@@ -0,0 +1,289 @@
+// router.hpp
+#ifndef ROUTER_HPP
+#define ROUTER_HPP
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// -------------------------
+// HTTP Methods
+// -------------------------
+enum class HttpMethod : uint8_t { GET, HEAD, POST, PUT, DELETE, PATCH, OPTIONS, unknown };
+
+inline constexpr size_t kHttpMethodCount = static_cast<size_t>(HttpMethod::unknown);
+
+inline HttpMethod parse_method(std::string_view method) {
+    switch (method.size()) {
+    case 3:
+        if (method == "GET") return HttpMethod::GET;
+        if (method == "PUT") return HttpMethod::PUT;
+        break;
+    case 4:
+        if (method == "POST") return HttpMethod::POST;
+        if (method == "HEAD") return HttpMethod::HEAD;
+        break;
+    case 5:
+        if (method == "PATCH") return HttpMethod::PATCH;
+        break;
+    case 6:
+        if (method == "DELETE") return HttpMethod::DELETE;
+        break;
+    case 7:
+        if (method == "OPTIONS") return HttpMethod::OPTIONS;
+        break;
+    }
+    return HttpMethod::unknown;
+}
+
+// -------------------------
+// Route Declarations
+// -------------------------
+// Routes are declared as a constexpr table of RouteSpecs and loaded into a
+// Router once at startup. A pattern segment starting with ':' captures that
+// segment of the path, e.g. "/api/jobs/:id".
+template <typename Handler>
+struct RouteSpec {
+    HttpMethod method;
+    std::string_view pattern;
+    Handler handler;
+};
+
+// Captured path parameters. Fixed capacity so matching never allocates; the
+// views point into the request path.
+class RouteParams {
+public:
+    static constexpr size_t kMaxParams = 8;
+
+    std::string_view get(std::string_view name) const {
+        for (size_t i = 0; i < size_; ++i) {
+            if (params_[i].first == name) {
+                return params_[i].second;
+            }
+        }
+        return {};
+    }
+
+    size_t size() const { return size_; }
+    std::string_view name(size_t index) const { return params_[index].first; }
+    std::string_view value(size_t index) const { return params_[index].second; }
+
+    void clear() { size_ = 0; }
+    // Drops the parameters captured after the first size.
+    void truncate(size_t size) { size_ = size < size_ ? size : size_; }
+
+    bool push(std::string_view name, std::string_view value) {
+        if (size_ == kMaxParams) {
+            return false;
+        }
+        params_[size_++] = {name, value};
+        return true;
+    }
+
+private:
+    std::array<std::pair<std::string_view, std::string_view>, kMaxParams> params_;
+    size_t size_ = 0;
+};
+
+// -------------------------
+// Router Class
+// -------------------------
+// Segment trie over the path, with the method resolved by a per-node table,
+// so lookup cost depends on the number of path segments and not on the
+// number of routes. Children with few siblings are kept in a small vector
+// scanned linearly; wider fan-outs switch to a hash table. A static segment
+// is tried before a ':param' sibling; if nothing under it has a handler for
+// the request's method, the lookup backs up and tries the parameter. A path
+// that routes somewhere but never with the method is method_not_allowed.
+template <typename Handler>
+class Router {
+public:
+    enum class Status { found, not_found, method_not_allowed };
+
+    struct Match {
+        Status status = Status::not_found;
+        const Handler *handler = nullptr;
+    };
+
+    Router() : nodes_(1) {}
+
+    template <size_t N>
+    explicit Router(const RouteSpec<Handler> (&routes)[N]) : Router() {
+        for (const auto &route : routes) {
+            add(route.method, route.pattern, route.handler);
+        }
+    }
+
+    void add(HttpMethod method, std::string_view pattern, Handler handler) {
+        if (pattern.empty() || pattern.front() != '/' || method == HttpMethod::unknown) {
+            throw std::invalid_argument("invalid route: " + std::string(pattern));
+        }
+        // The trie keeps views into the pattern, so it owns a stable copy.
+        patterns_.push_back(std::make_unique<std::string>(pattern));
+        std::string_view rest = *patterns_.back();
+
+        uint32_t node = 0;
+        size_t num_params = 0;
+        while (next_segment(rest)) {
+            std::string_view segment = take_segment(rest);
+            if (!segment.empty() && segment.front() == ':') {
+                if (++num_params > RouteParams::kMaxParams) {
+                    throw std::invalid_argument("too many parameters in route: " + std::string(pattern));
+                }
+                if (nodes_[node].param_child == kNone) {
+                    uint32_t child = new_node();
+                    nodes_[node].param_child = child;
+                    nodes_[child].param_name = segment.substr(1);
+                } else if (nodes_[nodes_[node].param_child].param_name != segment.substr(1)) {
+                    throw std::invalid_argument("conflicting parameter names in route: " + std::string(pattern));
+                }
+                node = nodes_[node].param_child;
+            } else {
+                uint32_t child = find_static(node, segment);
+                if (child == kNone) {
+                    child = new_node();
+                    add_static(node, segment, child);
+                }
+                node = child;
+            }
+        }
+
+        auto &slot = nodes_[node].handlers[static_cast<size_t>(method)];
+        if (slot != kNone) {
+            throw std::invalid_argument("duplicate route: " + std::string(pattern));
+        }
+        slot = static_cast<uint32_t>(handlers_.size());
+        handlers_.push_back(std::move(handler));
+    }
+
+    // Match a request path (query string excluded by the caller or here).
+    Match find(HttpMethod method, std::string_view path, RouteParams &params) const {
+        params.clear();
+        size_t query = path.find('?');
+        if (query != std::string_view::npos) {
+            path = path.substr(0, query);
+        }
+        Match match;
+        if (!descend(0, path, method, params, match)) {
+            params.clear();
+        }
+        return match;
+    }
+
+    size_t size() const { return handlers_.size(); }
+
+private:
+    static constexpr uint32_t kNone = UINT32_MAX;
+    static constexpr size_t kLinearChildren = 8;
+
+    struct Node {
+        Node() { handlers.fill(kNone); }
+
+        std::vector<std::pair<std::string_view, uint32_t>> children;
+        std::unordered_map<std::string_view, uint32_t> child_index;  // used past kLinearChildren
+        uint32_t param_child = kNone;
+        std::string_view param_name;
+        std::array<uint32_t, kHttpMethodCount> handlers;
+    };
+
+    // Paths are split on '/'; "/a/b" yields "a", "b" and "/" yields nothing.
+    static bool next_segment(std::string_view &path) {
+        if (!path.empty() && path.front() == '/') {
+            path.remove_prefix(1);
+        }
+        return !path.empty();
+    }
+
+    static std::string_view take_segment(std::string_view &path) {
+        size_t slash = path.find('/');
+        std::string_view segment = path.substr(0, slash);
+        path.remove_prefix(slash == std::string_view::npos ? path.size() : slash);
+        return segment;
+    }
+
+    // Matches the rest of path below node, depth first, static child before
+    // the ':param' one. Returns true once a node with a handler for method
+    // is reached; the first node the path reaches with handlers for other
+    // methods only leaves method_not_allowed in match. It recurses only
+    // where a node has both a matching static child and a parameter child,
+    // so the depth is bounded by the routes, not by the request path.
+    bool descend(uint32_t node, std::string_view path, HttpMethod method, RouteParams &params,
+                 Match &match) const {
+        while (next_segment(path)) {
+            std::string_view segment = take_segment(path);
+            uint32_t child = find_static(node, segment);
+            uint32_t param = segment.empty() ? kNone : nodes_[node].param_child;
+            if (child != kNone && param != kNone) {
+                size_t captured = params.size();
+                if (descend(child, path, method, params, match)) {
+                    return true;
+                }
+                params.truncate(captured);
+                child = kNone;
+            }
+            if (child == kNone) {
+                if (param == kNone) {
+                    return false;
+                }
+                params.push(nodes_[param].param_name, segment);
+                child = param;
+            }
+            node = child;
+        }
+
+        const Node &target = nodes_[node];
+        if (method != HttpMethod::unknown) {
+            uint32_t index = target.handlers[static_cast<size_t>(method)];
+            if (index != kNone) {
+                match = {Status::found, &handlers_[index]};
+                return true;
+            }
+        }
+        for (uint32_t index : target.handlers) {
+            if (index != kNone) {
+                match = {Status::method_not_allowed, nullptr};
+                break;
+            }
+        }
+        return false;
+    }
+
+    uint32_t new_node() {
+        nodes_.emplace_back();
+        return static_cast<uint32_t>(nodes_.size() - 1);
+    }
+
+    uint32_t find_static(uint32_t node, std::string_view segment) const {
+        const Node &n = nodes_[node];
+        if (!n.child_index.empty()) {
+            auto it = n.child_index.find(segment);
+            return it == n.child_index.end() ? kNone : it->second;
+        }
+        for (const auto &child : n.children) {
+            if (child.first == segment) {
+                return child.second;
+            }
+        }
+        return kNone;
+    }
+
+    void add_static(uint32_t node, std::string_view segment, uint32_t child) {
+        Node &n = nodes_[node];
+        n.children.emplace_back(segment, child);
+        if (n.children.size() > kLinearChildren) {
+            n.child_index.insert(n.children.begin(), n.children.end());
+        }
+    }
+
+    std::vector<Node> nodes_;
+    std::vector<Handler> handlers_;
+    std::vector<std::unique_ptr<std::string>> patterns_;
+};
+
+#endif // ROUTER_HPP
@@ -0,0 +1,211 @@
+// simd_scan.hpp
+#ifndef SIMD_SCAN_HPP
+#define SIMD_SCAN_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_SCAN_X86 1
+#endif
+
+// -------------------------
+// Delimiter Scanning Kernels
+// -------------------------
+// Each scan returns the index of the first delimiter byte in [data, data+size),
+// or size if there is none. The AVX2 and SSE4.2 kernels look at 32 and 16
+// bytes per step; the best one the CPU supports is picked once at startup and
+// the short tails are finished by the scalar code.
+namespace simd_scan {
+
+// Request target: stops at SP, other controls and DEL.
+inline bool is_target_delimiter(unsigned char c) { return c <= 0x20 || c == 0x7f; }
+// Field value: stops at controls other than HTAB (so at CR and LF) and DEL.
+inline bool is_value_delimiter(unsigned char c) { return (c < 0x20 && c != '\t') || c == 0x7f; }
+// Field name: stops at ':' and at anything that can never be part of a token.
+inline bool is_name_delimiter(unsigned char c) { return c <= 0x20 || c == ':' || c == 0x7f; }
+
+template <bool (*IsDelimiter)(unsigned char)>
+inline size_t scan_scalar(const char *data, size_t pos, size_t size) {
+    while (pos < size && !IsDelimiter(static_cast<unsigned char>(data[pos]))) {
+        ++pos;
+    }
+    return pos;
+}
+
+inline size_t find_target_end_scalar(const char *data, size_t size) {
+    return scan_scalar<is_target_delimiter>(data, 0, size);
+}
+inline size_t find_value_end_scalar(const char *data, size_t size) {
+    return scan_scalar<is_value_delimiter>(data, 0, size);
+}
+inline size_t find_name_end_scalar(const char *data, size_t size) {
+    return scan_scalar<is_name_delimiter>(data, 0, size);
+}
+
+// Offset just past the first "\r\n\r\n", or 0 if the block is not complete.
+inline size_t find_head_end_scalar(const char *data, size_t size) {
+    for (size_t i = 0; i + 4 <= size; ++i) {
+        if (data[i] == '\r' && data[i + 1] == '\n' && data[i + 2] == '\r' && data[i + 3] == '\n') {
+            return i + 4;
+        }
+    }
+    return 0;
+}
+
+#ifdef SIMD_SCAN_X86
+
+// SSE4.2: PCMPESTRI matches the delimiter byte ranges directly.
+#define SIMD_SCAN_SSE42_KERNEL(name, ranges_literal, ranges_length, delimiter)               \
+    __attribute__((target("sse4.2"))) inline size_t name(const char *data, size_t size) {    \
+        const __m128i ranges = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ranges_literal)); \
+        size_t pos = 0;                                                                     \
+        for (; pos + 16 <= size; pos += 16) {                                                \
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));  \
+            int index = _mm_cmpestri(ranges, ranges_length, block, 16,                       \
+                                     _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT); \
+            if (index != 16) {                                                               \
+                return pos + static_cast<size_t>(index);                                     \
+            }                                                                                \
+        }                                                                                    \
+        return scan_scalar<delimiter>(data, pos, size);                                      \
+    }
+
+// Range pairs are padded to 16 bytes so the load never reads past the literal.
+SIMD_SCAN_SSE42_KERNEL(find_target_end_sse42, "\x00\x20\x7f\x7f\0\0\0\0\0\0\0\0\0\0\0", 4, is_target_delimiter)
+SIMD_SCAN_SSE42_KERNEL(find_value_end_sse42, "\x00\x08\x0a\x1f\x7f\x7f\0\0\0\0\0\0\0\0\0", 6, is_value_delimiter)
+SIMD_SCAN_SSE42_KERNEL(find_name_end_sse42, "\x00\x20\x3a\x3a\x7f\x7f\0\0\0\0\0\0\0\0\0", 6, is_name_delimiter)
+
+#undef SIMD_SCAN_SSE42_KERNEL
+
+__attribute__((target("sse4.2"))) inline size_t find_head_end_sse42(const char *data, size_t size) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    size_t pos = 0;
+    for (; pos + 19 <= size; pos += 16) {
+        const __m128i *p = reinterpret_cast<const __m128i *>(data + pos);
+        const __m128i *p1 = reinterpret_cast<const __m128i *>(data + pos + 1);
+        const __m128i *p2 = reinterpret_cast<const __m128i *>(data + pos + 2);
+        const __m128i *p3 = reinterpret_cast<const __m128i *>(data + pos + 3);
+        __m128i match = _mm_and_si128(
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(p), cr), _mm_cmpeq_epi8(_mm_loadu_si128(p1), lf)),
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(p2), cr), _mm_cmpeq_epi8(_mm_loadu_si128(p3), lf)));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(match));
+        if (mask != 0) {
+            return pos + static_cast<size_t>(__builtin_ctz(mask)) + 4;
+        }
+    }
+    size_t tail = find_head_end_scalar(data + pos, size - pos);
+    return tail ? pos + tail : 0;
+}
+
+// AVX2: there is no range compare, so each class is built from unsigned
+// max compares: max(c, lo) == c  <=>  c >= lo.
+#define SIMD_SCAN_AVX2_AT_LEAST(block, lo) \
+    _mm256_cmpeq_epi8(_mm256_max_epu8((block), _mm256_set1_epi8(lo)), (block))
+
+__attribute__((target("avx2"))) inline size_t find_target_end_avx2(const char *data, size_t size) {
+    size_t pos = 0;
+    for (; pos + 32 <= size; pos += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + pos));
+        __m256i ok = _mm256_andnot_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(0x7f)),
+                                         SIMD_SCAN_AVX2_AT_LEAST(block, 0x21));
+        unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(ok));
+        if (mask != 0) {
+            return pos + static_cast<size_t>(__builtin_ctz(mask));
+        }
+    }
+    return scan_scalar<is_target_delimiter>(data, pos, size);
+}
+
+__attribute__((target("avx2"))) inline size_t find_value_end_avx2(const char *data, size_t size) {
+    size_t pos = 0;
+    for (; pos + 32 <= size; pos += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + pos));
+        __m256i ok = _mm256_or_si256(SIMD_SCAN_AVX2_AT_LEAST(block, 0x20),
+                                     _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\t')));
+        ok = _mm256_andnot_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(0x7f)), ok);
+        unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(ok));
+        if (mask != 0) {
+            return pos + static_cast<size_t>(__builtin_ctz(mask));
+        }
+    }
+    return scan_scalar<is_value_delimiter>(data, pos, size);
+}
+
+__attribute__((target("avx2"))) inline size_t find_name_end_avx2(const char *data, size_t size) {
+    size_t pos = 0;
+    for (; pos + 32 <= size; pos += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + pos));
+        __m256i bad = _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(':')),
+                                      _mm256_cmpeq_epi8(block, _mm256_set1_epi8(0x7f)));
+        __m256i ok = _mm256_andnot_si256(bad, SIMD_SCAN_AVX2_AT_LEAST(block, 0x21));
+        unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(ok));
+        if (mask != 0) {
+            return pos + static_cast<size_t>(__builtin_ctz(mask));
+        }
+    }
+    return scan_scalar<is_name_delimiter>(data, pos, size);
+}
+
+__attribute__((target("avx2"))) inline size_t find_head_end_avx2(const char *data, size_t size) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    size_t pos = 0;
+    for (; pos + 35 <= size; pos += 32) {
+        const __m256i *p = reinterpret_cast<const __m256i *>(data + pos);
+        const __m256i *p1 = reinterpret_cast<const __m256i *>(data + pos + 1);
+        const __m256i *p2 = reinterpret_cast<const __m256i *>(data + pos + 2);
+        const __m256i *p3 = reinterpret_cast<const __m256i *>(data + pos + 3);
+        __m256i match = _mm256_and_si256(
+            _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256(p), cr), _mm256_cmpeq_epi8(_mm256_loadu_si256(p1), lf)),
+            _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256(p2), cr), _mm256_cmpeq_epi8(_mm256_loadu_si256(p3), lf)));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(match));
+        if (mask != 0) {
+            return pos + static_cast<size_t>(__builtin_ctz(mask)) + 4;
+        }
+    }
+    size_t tail = find_head_end_scalar(data + pos, size - pos);
+    return tail ? pos + tail : 0;
+}
+
+#undef SIMD_SCAN_AVX2_AT_LEAST
+
+#endif // SIMD_SCAN_X86
+
+// -------------------------
+// Runtime Dispatch
+// -------------------------
+struct Kernels {
+    const char *name;
+    size_t (*find_target_end)(const char *, size_t);
+    size_t (*find_value_end)(const char *, size_t);
+    size_t (*find_name_end)(const char *, size_t);
+    size_t (*find_head_end)(const char *, size_t);
+};
+
+inline Kernels select_kernels() {
+#ifdef SIMD_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {"avx2", find_target_end_avx2, find_value_end_avx2, find_name_end_avx2, find_head_end_avx2};
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return {"sse4.2", find_target_end_sse42, find_value_end_sse42, find_name_end_sse42, find_head_end_sse42};
+    }
+#endif
+    return {"scalar", find_target_end_scalar, find_value_end_scalar, find_name_end_scalar, find_head_end_scalar};
+}
+
+inline const Kernels kernels = select_kernels();
+
+inline size_t find_target_end(const char *data, size_t size) { return kernels.find_target_end(data, size); }
+inline size_t find_value_end(const char *data, size_t size) { return kernels.find_value_end(data, size); }
+inline size_t find_name_end(const char *data, size_t size) { return kernels.find_name_end(data, size); }
+inline size_t find_head_end(const char *data, size_t size) { return kernels.find_head_end(data, size); }
+
+} // namespace simd_scan
+
+#endif // SIMD_SCAN_HPP
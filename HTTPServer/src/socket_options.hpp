@@ -0,0 +1,157 @@
+// socket_options.hpp
+#ifndef SOCKET_OPTIONS_HPP
+#define SOCKET_OPTIONS_HPP
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// -------------------------
+// Socket Options
+// -------------------------
+// TCP tuning for listening and accepted sockets, chosen as a profile and
+// adjusted option by option so tail latency can be compared per profile.
+// Everything that Linux copies from a listener to the sockets it accepts
+// (TCP_NODELAY, SO_RCVBUF, SO_SNDBUF) is set once on the listener, so an
+// accept costs no extra system calls; only TCP_QUICKACK, which the kernel
+// does not inherit, is set on each accepted socket. The buffer sizes must
+// be in place before listen() for the window scale offered in the SYN-ACK
+// to match them.
+namespace socket_options {
+
+struct Options {
+    bool no_delay = true;        // TCP_NODELAY: no Nagle delay on responses
+    bool quick_ack = false;      // TCP_QUICKACK on accept: no delayed ACK for the first request
+    int defer_accept_s = 0;      // TCP_DEFER_ACCEPT: accept only once data has arrived; 0 is off
+    int fastopen_queue = 0;      // TCP_FASTOPEN queue length; 0 is off
+    int receive_buffer = 0;      // SO_RCVBUF bytes; 0 keeps the kernel's autotuning
+    int send_buffer = 0;         // SO_SNDBUF bytes; 0 keeps the kernel's autotuning
+    int backlog = SOMAXCONN;     // listen() backlog, capped by net.core.somaxconn
+    bool incoming_cpu = false;   // SO_INCOMING_CPU on per-thread listeners of pinned threads
+};
+
+// kernel: nothing set, every option at the kernel's default.
+// default: TCP_NODELAY only.
+// latency: also quick ACKs, deferred accept, TCP Fast Open and listeners
+// steered to the CPU of their I/O thread.
+inline Options profile(const std::string &name) {
+    Options options;
+    if (name == "kernel") {
+        options.no_delay = false;
+    } else if (name == "latency") {
+        options.quick_ack = true;
+        options.defer_accept_s = 1;
+        options.fastopen_queue = 256;
+        options.incoming_cpu = true;
+    } else if (name != "default") {
+        throw std::invalid_argument("unknown socket profile: " + name);
+    }
+    return options;
+}
+
+inline bool parse_switch(const std::string &text) {
+    if (text == "on") {
+        return true;
+    }
+    if (text == "off") {
+        return false;
+    }
+    throw std::invalid_argument("expected on or off, got " + text);
+}
+
+inline void warn_once(bool &warned, const char *option) {
+    if (!warned) {
+        warned = true;
+        fprintf(stderr, "%s not applied: %s\n", option, strerror(errno));
+    }
+}
+
+// Before listen(). cpu is the CPU for SO_INCOMING_CPU, or -1. Failures are
+// reported once per option and otherwise ignored: the listener still works.
+inline void apply_listener(int fd, const Options &options, int cpu) {
+    static bool warned[6] = {};
+    int one = 1;
+    if (options.no_delay && setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) < 0) {
+        warn_once(warned[0], "TCP_NODELAY");
+    }
+    if (options.defer_accept_s > 0 &&
+        setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &options.defer_accept_s, sizeof(int)) < 0) {
+        warn_once(warned[1], "TCP_DEFER_ACCEPT");
+    }
+    if (options.fastopen_queue > 0 &&
+        setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN, &options.fastopen_queue, sizeof(int)) < 0) {
+        warn_once(warned[2], "TCP_FASTOPEN");
+    }
+    if (options.receive_buffer > 0 &&
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &options.receive_buffer, sizeof(int)) < 0) {
+        warn_once(warned[3], "SO_RCVBUF");
+    }
+    if (options.send_buffer > 0 && setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &options.send_buffer, sizeof(int)) < 0) {
+        warn_once(warned[4], "SO_SNDBUF");
+    }
+    if (options.incoming_cpu && cpu >= 0 && setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) < 0) {
+        warn_once(warned[5], "SO_INCOMING_CPU");
+    }
+}
+
+// Called for every accepted socket; one system call at most.
+inline void apply_accepted(int fd, const Options &options) {
+    static bool warned = false;
+    int one = 1;
+    if (options.quick_ack && setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &one, sizeof(one)) < 0) {
+        warn_once(warned, "TCP_QUICKACK");
+    }
+}
+
+inline int somaxconn() {
+    std::ifstream file("/proc/sys/net/core/somaxconn");
+    int value = SOMAXCONN;
+    file >> value;
+    return value;
+}
+
+inline int get_int(int fd, int level, int name) {
+    int value = -1;
+    socklen_t length = sizeof(value);
+    return getsockopt(fd, level, name, &value, &length) == 0 ? value : -1;
+}
+
+// The values in effect on the listeners, as the kernel reports them: it
+// doubles buffer sizes and rounds TCP_DEFER_ACCEPT to a retransmission.
+inline std::string describe(const std::vector<int> &listeners, const Options &options) {
+    if (listeners.empty()) {
+        return "no listeners";
+    }
+    int fd = listeners.front();
+    auto on_off = [](int value) { return std::string(value > 0 ? "on" : "off"); };
+    std::string text = "TCP_NODELAY " + on_off(get_int(fd, IPPROTO_TCP, TCP_NODELAY)) +
+                       ", TCP_QUICKACK " + (options.quick_ack ? "on accept" : "off") +
+                       ", TCP_DEFER_ACCEPT " + std::to_string(get_int(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT)) + " s" +
+                       ", TCP_FASTOPEN queue " + std::to_string(get_int(fd, IPPROTO_TCP, TCP_FASTOPEN)) +
+                       ", SO_RCVBUF " + std::to_string(get_int(fd, SOL_SOCKET, SO_RCVBUF)) +
+                       (options.receive_buffer > 0 ? "" : " (autotuned)") +
+                       ", SO_SNDBUF " + std::to_string(get_int(fd, SOL_SOCKET, SO_SNDBUF)) +
+                       (options.send_buffer > 0 ? "" : " (autotuned)") +
+                       ", backlog " + std::to_string(std::min(options.backlog, somaxconn())) +
+                       ", SO_INCOMING_CPU ";
+    std::string cpus;
+    for (int listener : listeners) {
+        int cpu = get_int(listener, SOL_SOCKET, SO_INCOMING_CPU);
+        if (cpu >= 0) {
+            cpus += (cpus.empty() ? "" : ",") + std::to_string(cpu);
+        }
+    }
+    return text + (cpus.empty() ? "off" : cpus);
+}
+
+} // namespace socket_options
+
+#endif // SOCKET_OPTIONS_HPP
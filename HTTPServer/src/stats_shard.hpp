@@ -0,0 +1,121 @@
+// stats_shard.hpp
+#ifndef STATS_SHARD_HPP
+#define STATS_SHARD_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// -------------------------
+// Load Errors
+// -------------------------
+// Why a load generator request failed.
+enum class LoadError : uint8_t {
+    connect,       // the connection could not be opened
+    closed,        // closed by the target before any of the response arrived
+    bad_response,  // malformed, oversized or cut off part way
+    setup,         // the worker could not start or stopped early; its remaining budget failed
+};
+
+constexpr size_t kLoadErrorKinds = 4;
+
+inline const char *load_error_name(LoadError error) {
+    switch (error) {
+    case LoadError::connect:
+        return "connect";
+    case LoadError::closed:
+        return "closed";
+    case LoadError::bad_response:
+        return "bad_response";
+    case LoadError::setup:
+        return "setup";
+    }
+    return "unknown";
+}
+
+// -------------------------
+// StatsShard Struct
+// -------------------------
+// One load generator thread's counters. Each shard starts on a cache line
+// of its own and is padded to whole lines, so no two threads ever write to
+// the same line, and it has a single writer, which bumps a counter with a
+// relaxed load and store rather than a locked read-modify-write. Readers
+// only add the shards up, through ShardedStats::merge(), to report.
+struct alignas(64) StatsShard {
+    std::atomic<uint64_t> requests{0};  // responses received in full
+    std::atomic<uint64_t> failures{0};
+    // Keep-alive connections that had to be opened again: the server closed
+    // them, a request on them failed, or a response said Connection: close.
+    std::atomic<uint64_t> reconnects{0};
+    std::atomic<uint64_t> bytes_sent{0};
+    std::atomic<uint64_t> bytes_received{0};
+    // Responses by status class: [1] to [5] for 1xx to 5xx, [0] for others.
+    std::array<std::atomic<uint64_t>, 6> status_classes{};
+    std::array<std::atomic<uint64_t>, kLoadErrorKinds> errors{};
+
+    static void bump(std::atomic<uint64_t> &counter, uint64_t n = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    void count_response(int status_code) {
+        bump(requests);
+        bump(status_classes[status_code >= 100 && status_code < 600 ? status_code / 100 : 0]);
+    }
+
+    void count_error(LoadError error, uint64_t n = 1) {
+        bump(failures, n);
+        bump(errors[static_cast<size_t>(error)], n);
+    }
+};
+
+// -------------------------
+// ShardedStats Class
+// -------------------------
+// A fixed set of shards, one per thread, and their sum.
+class ShardedStats {
+public:
+    struct Totals {
+        uint64_t requests = 0;
+        uint64_t failures = 0;
+        uint64_t reconnects = 0;
+        uint64_t bytes_sent = 0;
+        uint64_t bytes_received = 0;
+        std::array<uint64_t, 6> status_classes{};
+        std::array<uint64_t, kLoadErrorKinds> errors{};
+    };
+
+    explicit ShardedStats(size_t shards) : shards_(std::make_unique<StatsShard[]>(shards)), size_(shards) {}
+
+    StatsShard &shard(size_t index) { return shards_[index]; }
+    size_t size() const { return size_; }
+
+    // Sums the shards. While writers are running the counters are each
+    // up to date but not taken at one instant.
+    Totals merge() const {
+        Totals totals;
+        auto get = [](const std::atomic<uint64_t> &counter) { return counter.load(std::memory_order_relaxed); };
+        for (size_t i = 0; i < size_; ++i) {
+            const StatsShard &shard = shards_[i];
+            totals.requests += get(shard.requests);
+            totals.failures += get(shard.failures);
+            totals.reconnects += get(shard.reconnects);
+            totals.bytes_sent += get(shard.bytes_sent);
+            totals.bytes_received += get(shard.bytes_received);
+            for (size_t j = 0; j < totals.status_classes.size(); ++j) {
+                totals.status_classes[j] += get(shard.status_classes[j]);
+            }
+            for (size_t j = 0; j < kLoadErrorKinds; ++j) {
+                totals.errors[j] += get(shard.errors[j]);
+            }
+        }
+        return totals;
+    }
+
+private:
+    std::unique_ptr<StatsShard[]> shards_;
+    size_t size_;
+};
+
+#endif // STATS_SHARD_HPP
@@ -0,0 +1,206 @@
+// timing_wheel.hpp
+#ifndef TIMING_WHEEL_HPP
+#define TIMING_WHEEL_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+class TimingWheel;
+
+// -------------------------
+// WheelTimer Class
+// -------------------------
+// An intrusive timer: the node lives inside its owner (a connection), so
+// arming and cancelling never allocate. When it expires the wheel calls
+// callback(context). Destroying an armed timer cancels it.
+class WheelTimer {
+public:
+    using Callback = void (*)(void *context);
+
+    WheelTimer(Callback callback, void *context) : callback_(callback), context_(context) {}
+    ~WheelTimer();
+
+    WheelTimer(const WheelTimer &) = delete;
+    WheelTimer &operator=(const WheelTimer &) = delete;
+
+    bool armed() const { return wheel_ != nullptr; }
+
+private:
+    friend class TimingWheel;
+
+    struct Link {
+        Link *prev = this;
+        Link *next = this;
+    };
+
+    Link link_;  // first member, so a Link * in a slot list is the timer
+    uint64_t expiry_tick_ = 0;
+    Callback callback_;
+    void *context_;
+    TimingWheel *wheel_ = nullptr;
+};
+
+// -------------------------
+// TimingWheel Class
+// -------------------------
+// A hierarchical timing wheel for one I/O thread: four levels of 64 slots
+// with a 10 ms tick, covering about 46 hours. A timer goes into the level
+// whose span holds its delay, so schedule() and cancel() are O(1) list
+// operations whatever the number of timers. advance() is called once per
+// tick: it moves the timers of a higher-level slot down when the level
+// below wraps around, then expires the whole current level-0 slot as a
+// batch. Not thread-safe.
+class TimingWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::chrono::milliseconds kTick{10};
+    static constexpr unsigned kSlotBits = 6;
+    static constexpr unsigned kSlots = 1u << kSlotBits;
+    static constexpr unsigned kLevels = 4;
+    static constexpr uint64_t kMaxDelay = (uint64_t(1) << (kSlotBits * kLevels)) - 1;
+
+    TimingWheel() : current_tick_(tick_of(Clock::now())) {}
+
+    TimingWheel(const TimingWheel &) = delete;
+    TimingWheel &operator=(const TimingWheel &) = delete;
+
+    // (Re)arm timer to expire timeout from now, rounded up to whole ticks.
+    void schedule(WheelTimer &timer, Clock::duration timeout) {
+        if (timer.armed()) {
+            cancel(timer);
+        }
+        if (size_ == 0) {
+            // Nothing has advanced the wheel while it was empty.
+            current_tick_ = tick_of(Clock::now());
+        }
+        uint64_t ticks = static_cast<uint64_t>((timeout + kTick - Clock::duration(1)) / kTick) + 1;
+        timer.expiry_tick_ = current_tick_ + (ticks < kMaxDelay ? ticks : kMaxDelay);
+        timer.wheel_ = this;
+        insert(timer);
+        ++size_;
+    }
+
+    void cancel(WheelTimer &timer) {
+        if (!timer.armed()) {
+            return;
+        }
+        unlink(timer.link_);
+        timer.wheel_ = nullptr;
+        --size_;
+    }
+
+    // Expire every timer that is due by now; returns how many fired.
+    // Callbacks may schedule or cancel any timer, including others in the
+    // batch being expired.
+    size_t advance(Clock::time_point now) {
+        uint64_t target = tick_of(now);
+        size_t fired = 0;
+        while (current_tick_ < target) {
+            ++current_tick_;
+            for (unsigned level = 1; level < kLevels; ++level) {
+                if (((current_tick_ >> (kSlotBits * (level - 1))) & (kSlots - 1)) != 0) {
+                    break;
+                }
+                cascade(level);
+            }
+            fired += expire(slots_[0][current_tick_ & (kSlots - 1)]);
+            if (size_ == 0) {
+                current_tick_ = target;
+            }
+        }
+        return fired;
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+private:
+    using Link = WheelTimer::Link;
+
+    static uint64_t tick_of(Clock::time_point time) {
+        return static_cast<uint64_t>(time.time_since_epoch() / kTick);
+    }
+
+    static WheelTimer &timer_of(Link *link) {
+        return *reinterpret_cast<WheelTimer *>(link);
+    }
+
+    static void unlink(Link &link) {
+        link.prev->next = link.next;
+        link.next->prev = link.prev;
+        link.prev = link.next = &link;
+    }
+
+    static void push_back(Link &list, Link &link) {
+        link.prev = list.prev;
+        link.next = &list;
+        list.prev->next = &link;
+        list.prev = &link;
+    }
+
+    void insert(WheelTimer &timer) {
+        uint64_t delay = timer.expiry_tick_ - current_tick_;
+        unsigned level = 0;
+        while (level + 1 < kLevels && delay >= (uint64_t(1) << (kSlotBits * (level + 1)))) {
+            ++level;
+        }
+        unsigned slot = static_cast<unsigned>((timer.expiry_tick_ >> (kSlotBits * level)) & (kSlots - 1));
+        push_back(slots_[level][slot], timer.link_);
+    }
+
+    // Re-file the timers of the level's current slot; they are now close
+    // enough for a lower level.
+    void cascade(unsigned level) {
+        Link &slot = slots_[level][(current_tick_ >> (kSlotBits * level)) & (kSlots - 1)];
+        Link pending;
+        splice(slot, pending);
+        while (pending.next != &pending) {
+            Link *link = pending.next;
+            unlink(*link);
+            insert(timer_of(link));
+        }
+    }
+
+    size_t expire(Link &slot) {
+        Link due;
+        splice(slot, due);
+        size_t fired = 0;
+        while (due.next != &due) {
+            Link *link = due.next;
+            WheelTimer &timer = timer_of(link);
+            unlink(*link);
+            timer.wheel_ = nullptr;
+            --size_;
+            ++fired;
+            timer.callback_(timer.context_);
+        }
+        return fired;
+    }
+
+    // Move every node of from onto the empty list to.
+    static void splice(Link &from, Link &to) {
+        if (from.next == &from) {
+            return;
+        }
+        to.next = from.next;
+        to.prev = from.prev;
+        to.next->prev = &to;
+        to.prev->next = &to;
+        from.prev = from.next = &from;
+    }
+
+    std::array<std::array<Link, kSlots>, kLevels> slots_;
+    uint64_t current_tick_;
+    size_t size_ = 0;
+};
+
+inline WheelTimer::~WheelTimer() {
+    if (wheel_) {
+        wheel_->cancel(*this);
+    }
+}
+
+#endif // TIMING_WHEEL_HPP